@@ -0,0 +1,246 @@
+/*
+ *	BATCH.C
+ *	Tom Kerrigan's Simple Chess Program (TSCP)
+ *
+ *	Copyright 2016 Tom Kerrigan
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "defs.h"
+#include "data.h"
+#include "protos.h"
+
+
+/* Batch mode analyzes a stream of positions, one FEN per line, and
+   writes one line of JSON for each of them, in the same order as the
+   input, e.g.:
+
+   {"fen":"...","bestmove":"e2e4","score":30,"depth":6,"nodes":51234,"time":41,"pv":["e2e4","e7e5"]}
+
+   Positions that set_fen() doesn't like get {"fen":"...","error":"illegal position"}
+   instead, and blank lines and lines starting with '#' are skipped. A
+   line can be as long as the ones the input thread reads (BATCH_LINE),
+   e.g., a FEN with EPD operations after it (which set_fen() ignores).
+   A longer one gets {"fen":"...","error":"line too long"} with its
+   start.
+
+   The positions are analyzed by a pool of worker threads, each with its
+   own engine (and transposition table), so the workers never wait for
+   each other. They take positions from a shared list, so a worker that
+   gets easy positions just does more of them. The list is filled a
+   chunk at a time, and the results of a chunk are printed once all of
+   its positions are done, which keeps the output in order without
+   keeping the whole input in memory. */
+
+
+#define BATCH_CHUNK		256  /* positions per worker per chunk */
+#define BATCH_LINE		8192  /* the longest line, like in input_thread() */
+#define BATCH_OUT		1024  /* room for a position's JSON, besides its FEN */
+
+
+typedef struct {
+	char *fen;
+	char *out;  /* with room for BATCH_OUT plus the FEN twice over */
+	BOOL too_long;  /* was the line longer than BATCH_LINE? */
+} batch_job_t;
+
+
+/* a worker thread and its engine */
+typedef struct {
+	engine_t *e;
+	batch_job_t *jobs;
+	int n;  /* the number of jobs in the chunk */
+	int *next;  /* the next job that nobody's taken yet */
+	void *mutex;  /* protects next */
+} batch_worker_t;
+
+
+/* json_str() writes s to out as a JSON string (with quotes) */
+
+void json_str(char *out, char *s)
+{
+	*out++ = '"';
+	for (; *s; ++s) {
+		if (*s == '"' || *s == '\\')
+			*out++ = '\\';
+		if ((unsigned char)*s >= ' ')
+			*out++ = *s;
+	}
+	*out++ = '"';
+	*out = '\0';
+}
+
+
+/* batch_position() analyzes the position fen and writes the result to
+   out */
+
+void batch_position(engine_t *e, char *fen, char *out)
+{
+	int i, t;
+	char s[6];
+
+	if (!set_fen(e, fen)) {
+		batch_error(fen, out, "illegal position");
+		return;
+	}
+	out += sprintf(out, "{\"fen\":");
+	json_str(out, fen);
+	out += strlen(out);
+
+	clear_tt(e->tt);
+	t = get_ms();
+	think(e, 0);
+	t = get_ms() - t;
+
+	if (e->pv[0][0].u)
+		out += sprintf(out, ",\"bestmove\":\"%s\"", move_to_str(e->pv[0][0].b, s));
+	else
+		out += sprintf(out, ",\"bestmove\":null");
+	out += sprintf(out, ",\"score\":%d,\"depth\":%d,\"nodes\":%d,\"time\":%d,\"pv\":[",
+			e->score, e->depth, e->nodes, t);
+	for (i = 0; i < e->pv_length[0]; ++i)
+		out += sprintf(out, "%s\"%s\"", i ? "," : "", move_to_str(e->pv[0][i].b, s));
+	sprintf(out, "]}");
+}
+
+
+/* batch_error() writes the result for the position fen that batch
+   mode couldn't analyze, because of error, to out */
+
+void batch_error(char *fen, char *out, char *error)
+{
+	out += sprintf(out, "{\"fen\":");
+	json_str(out, fen);
+	out += strlen(out);
+	sprintf(out, ",\"error\":\"%s\"}", error);
+}
+
+
+/* batch_thread() analyzes positions until there aren't any left in
+   the chunk */
+
+void batch_thread(void *arg)
+{
+	batch_worker_t *w = (batch_worker_t *)arg;
+	int i;
+
+	for (;;) {
+		lock_mutex(w->mutex);
+		i = (*w->next)++;
+		unlock_mutex(w->mutex);
+		if (i >= w->n)
+			break;
+		if (w->jobs[i].too_long)
+			batch_error(w->jobs[i].fen, w->jobs[i].out, "line too long");
+		else
+			batch_position(w->e, w->jobs[i].fen, w->jobs[i].out);
+	}
+}
+
+
+/* batch() analyzes the positions in the file name ("-" for stdin) with
+   e->threads workers. Each worker searches with e's limits and its own
+   single-threaded engine with a hash table as big as e's. */
+
+void batch(engine_t *e, char *name)
+{
+	FILE *f;
+	batch_worker_t w[MAX_THREADS];
+	void *thread[MAX_THREADS];
+	batch_job_t *jobs;
+	char line[BATCH_LINE];
+	char *p;
+	int workers = e->threads;
+	int size = workers * BATCH_CHUNK;
+	int n, next, i, c;
+	BOOL done = FALSE, too_long;
+	void *mutex;
+
+	f = strcmp(name, "-") ? fopen(name, "r") : stdin;
+	if (!f) {
+		printf("Can't open %s.\n", name);
+		return;
+	}
+	jobs = (batch_job_t *)malloc(size * sizeof(batch_job_t));
+	mutex = new_mutex();
+	if (!jobs || !mutex) {
+		printf("Can't allocate memory for batch mode.\n");
+		exit(1);
+	}
+	for (i = 0; i < workers; ++i) {
+		w[i].e = new_engine(e->tt->mb);
+		w[i].e->max_time = e->max_time;
+		w[i].e->max_depth = e->max_depth;
+		w[i].e->max_nodes = e->max_nodes;
+		w[i].e->selective = e->selective;
+		w[i].jobs = jobs;
+		w[i].next = &next;
+		w[i].mutex = mutex;
+	}
+
+	while (!done) {
+
+		/* read a chunk of positions */
+		n = 0;
+		while (n < size) {
+			if (!fgets(line, sizeof(line), f)) {
+				done = TRUE;
+				break;
+			}
+
+			/* if the line didn't fit, skip the rest of it */
+			too_long = !strchr(line, '\n') && !feof(f);
+			if (too_long)
+				while ((c = getc(f)) != EOF && c != '\n')
+					;
+			for (p = line + strlen(line); p > line && (unsigned char)p[-1] <= ' '; --p)
+				;
+			*p = '\0';
+			for (p = line; *p == ' ' || *p == '\t'; ++p)
+				;
+			if (!*p || *p == '#')
+				continue;
+			jobs[n].fen = (char *)malloc(strlen(p) + 1);
+			jobs[n].out = (char *)malloc(2 * strlen(p) + BATCH_OUT);
+			if (!jobs[n].fen || !jobs[n].out) {
+				printf("Can't allocate memory for batch mode.\n");
+				exit(1);
+			}
+			strcpy(jobs[n].fen, p);
+			jobs[n].too_long = too_long;
+			++n;
+		}
+		if (!n)
+			break;
+
+		/* analyze them; this thread is worker 0 */
+		next = 0;
+		for (i = 0; i < workers; ++i) {
+			w[i].n = n;
+			thread[i] = NULL;
+			if (i)
+				thread[i] = start_thread(batch_thread, &w[i]);
+		}
+		batch_thread(&w[0]);
+		for (i = 1; i < workers; ++i)
+			if (thread[i])
+				join_thread(thread[i]);
+
+		for (i = 0; i < n; ++i) {
+			printf("%s\n", jobs[i].out);
+			free(jobs[i].fen);
+			free(jobs[i].out);
+		}
+		fflush(stdout);
+	}
+
+	for (i = 0; i < workers; ++i)
+		free_engine(w[i].e);
+	free_mutex(mutex);
+	free(jobs);
+	if (f != stdin)
+		fclose(f);
+}
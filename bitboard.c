@@ -0,0 +1,234 @@
+/*
+ *	BITBOARD.C
+ *	Tom Kerrigan's Simple Chess Program (TSCP)
+ *
+ *	Copyright 2016 Tom Kerrigan
+ */
+
+
+#include "defs.h"
+#include "data.h"
+#include "protos.h"
+
+
+/* A bitboard is a 64-bit number where each bit stands for a square
+   of the board (bit 0 is A8 and bit 63 is H1, just like the squares
+   of the color and piece arrays). With bitboards we can answer
+   questions about all 64 squares at once, e.g., bb_color[LIGHT] &
+   knight_attacks[E5] is the set of white pieces that a knight on e5
+   attacks.
+
+   Knights, kings, and pawns always attack the same squares from a
+   given square, so those attacks are simply stored in arrays. Bishops,
+   rooks, and queens ("sliders") are harder because their attacks
+   depend on which squares are blocked. For those we use "magic
+   bitboards": we take the blockers that matter (the occupied squares
+   in the slider's mask), multiply them by a magic number, and use the
+   top bits of the result as an index into a table of precomputed
+   attacks. The magic numbers are found by trial and error in
+   init_bitboards(); they're just numbers that happen to map every
+   different set of blockers to an index that holds the right attacks.
+   On processors with the BMI2 instruction set the PEXT instruction
+   does the same job in one step (see BISHOP_ATTACKS in defs.h). */
+
+
+/* the tables that the bishop and rook magic entries point into */
+U64 bishop_table[5248];
+U64 rook_table[102400];
+
+
+/* slider_attacks() is the slow way of finding a slider's attacks: it
+   walks along each direction (dr, dc) from square sq until it runs
+   off the board or hits an occupied square. It's only used to fill
+   in the magic tables. */
+
+U64 slider_attacks(int sq, U64 occ, int dr[4], int dc[4])
+{
+	int i, r, c;
+	U64 b = 0;
+
+	for (i = 0; i < 4; ++i)
+		for (r = ROW(sq) + dr[i], c = COL(sq) + dc[i];
+				r >= 0 && r < 8 && c >= 0 && c < 8;
+				r += dr[i], c += dc[i]) {
+			b |= BIT(r * 8 + c);
+			if (occ & BIT(r * 8 + c))
+				break;
+		}
+	return b;
+}
+
+
+/* magic_rand() returns a random number with only a few bits set,
+   which makes a good magic number more likely. */
+
+U64 magic_rand()
+{
+	static U64 r = 728;
+	U64 n = ~0ULL;
+	int i;
+
+	for (i = 0; i < 3; ++i) {
+		r ^= r >> 12;
+		r ^= r << 25;
+		r ^= r >> 27;
+		n &= r * 2685821657736338717ULL;
+	}
+	return n;
+}
+
+
+/* init_magics() fills in the magic entries and attack table for
+   one kind of slider. The mask of a square is the squares the slider
+   attacks on an empty board, minus the edges of the board (a piece
+   on the edge can't block anything further). */
+
+void init_magics(magic_t *m, U64 *table, int dr[4], int dc[4])
+{
+	int sq, i, n, size;
+	U64 edges, b;
+	U64 occ[4096], att[4096];
+#ifndef USE_PEXT
+	int used[4096];
+	int attempt;
+#endif
+
+	for (sq = 0; sq < 64; ++sq) {
+		edges = 0;
+		for (i = 0; i < 8; ++i) {
+			if (ROW(sq) != 0)
+				edges |= BIT(i);
+			if (ROW(sq) != 7)
+				edges |= BIT(56 + i);
+			if (COL(sq) != 0)
+				edges |= BIT(i * 8);
+			if (COL(sq) != 7)
+				edges |= BIT(i * 8 + 7);
+		}
+		m[sq].mask = slider_attacks(sq, 0, dr, dc) & ~edges;
+		n = POPCOUNT(m[sq].mask);
+		m[sq].shift = 64 - n;
+		m[sq].attacks = table;
+		size = 1 << n;
+		table += size;
+
+		/* enumerate every subset of the mask (the "carry-rippler"
+		   trick) and find the attacks for each one */
+		b = 0;
+		i = 0;
+		do {
+			occ[i] = b;
+			att[i] = slider_attacks(sq, b, dr, dc);
+#ifdef USE_PEXT
+			m[sq].attacks[PEXT(b, m[sq].mask)] = att[i];
+#endif
+			++i;
+			b = (b - m[sq].mask) & m[sq].mask;
+		} while (b);
+
+#ifndef USE_PEXT
+		/* try random magics until one works. used[n] is the attempt
+		   that last filled in index n, so we don't have to clear the
+		   table between attempts. */
+		for (i = 0; i < size; ++i)
+			used[i] = 0;
+		for (attempt = 1;; ++attempt) {
+			m[sq].magic = magic_rand();
+			if (POPCOUNT((m[sq].mask * m[sq].magic) >> 56) < 6)
+				continue;
+			for (i = 0; i < size; ++i) {
+				n = (int)((occ[i] * m[sq].magic) >> m[sq].shift);
+				if (used[n] != attempt) {
+					used[n] = attempt;
+					m[sq].attacks[n] = att[i];
+				}
+				else if (m[sq].attacks[n] != att[i])
+					break;
+			}
+			if (i == size)
+				break;
+		}
+#endif
+	}
+}
+
+
+/* init_bitboards() initializes the attack tables. It must be called
+   before any moves are generated. */
+
+void init_bitboards()
+{
+	int sq, i, r, c;
+	int knight_dr[8] = { -2, -2, -1, -1, 1, 1, 2, 2 };
+	int knight_dc[8] = { -1, 1, -2, 2, -2, 2, -1, 1 };
+	int king_dr[8] = { -1, -1, -1, 0, 0, 1, 1, 1 };
+	int king_dc[8] = { -1, 0, 1, -1, 1, -1, 0, 1 };
+	int bishop_dr[4] = { -1, -1, 1, 1 };
+	int bishop_dc[4] = { -1, 1, -1, 1 };
+	int rook_dr[4] = { -1, 0, 0, 1 };
+	int rook_dc[4] = { 0, -1, 1, 0 };
+
+	for (sq = 0; sq < 64; ++sq) {
+		knight_attacks[sq] = 0;
+		king_attacks[sq] = 0;
+		for (i = 0; i < 8; ++i) {
+			r = ROW(sq) + knight_dr[i];
+			c = COL(sq) + knight_dc[i];
+			if (r >= 0 && r < 8 && c >= 0 && c < 8)
+				knight_attacks[sq] |= BIT(r * 8 + c);
+			r = ROW(sq) + king_dr[i];
+			c = COL(sq) + king_dc[i];
+			if (r >= 0 && r < 8 && c >= 0 && c < 8)
+				king_attacks[sq] |= BIT(r * 8 + c);
+		}
+
+		/* LIGHT pawns move toward row 0, DARK pawns toward row 7 */
+		pawn_attacks[LIGHT][sq] = 0;
+		pawn_attacks[DARK][sq] = 0;
+		if (ROW(sq) != 0) {
+			if (COL(sq) != 0)
+				pawn_attacks[LIGHT][sq] |= BIT(sq - 9);
+			if (COL(sq) != 7)
+				pawn_attacks[LIGHT][sq] |= BIT(sq - 7);
+		}
+		if (ROW(sq) != 7) {
+			if (COL(sq) != 0)
+				pawn_attacks[DARK][sq] |= BIT(sq + 7);
+			if (COL(sq) != 7)
+				pawn_attacks[DARK][sq] |= BIT(sq + 9);
+		}
+	}
+	init_magics(bishop_magic, bishop_table, bishop_dr, bishop_dc);
+	init_magics(rook_magic, rook_table, rook_dr, rook_dc);
+}
+
+
+/* lsb() and popcount() are used by the LSB and POPCOUNT macros in
+   defs.h on compilers that don't have built-in versions. lsb()
+   multiplies the lowest set bit by a De Bruijn sequence, which puts
+   a unique 6-bit pattern in the top bits for each possible bit. */
+
+int lsb(U64 b)
+{
+	static const int index[64] = {
+		 0,  1, 48,  2, 57, 49, 28,  3,
+		61, 58, 50, 42, 38, 29, 17,  4,
+		62, 55, 59, 36, 53, 51, 43, 22,
+		45, 39, 33, 30, 24, 18, 12,  5,
+		63, 47, 56, 27, 60, 41, 37, 16,
+		54, 35, 52, 21, 44, 32, 23, 11,
+		46, 26, 40, 15, 34, 20, 31, 10,
+		25, 14, 19,  9, 13,  8,  7,  6
+	};
+
+	return index[((b & (0 - b)) * 0x03f79d71b4cb0a89ULL) >> 58];
+}
+
+int popcount(U64 b)
+{
+	int n = 0;
+
+	for (; b; b &= b - 1)
+		++n;
+	return n;
+}
@@ -6,7 +6,11 @@
  */
 
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
 #include "defs.h"
 #include "data.h"
 #include "protos.h"
@@ -14,23 +18,288 @@
 
  /* init_board() sets the board to the initial game state. */
 
-void init_board()
+void init_board(engine_t *e)
 {
 	int i;
 
 	for (i = 0; i < 64; ++i) {
-		color[i] = init_color[i];
-		piece[i] = init_piece[i];
+		e->color[i] = init_color[i];
+		e->piece[i] = init_piece[i];
 	}
-	side = LIGHT;
-	xside = DARK;
-	castle = 15;
+	e->side = LIGHT;
+	e->xside = DARK;
+	e->castle = 15;
+	e->ep = -1;
+	e->fifty = 0;
+	e->ply = 0;
+	e->hply = 0;
+	e->fen_start = FALSE;
+	set_bitboards(e);
+	set_hash(e);  /* init_hash() must be called before this function */
+	e->first_move[0] = 0;
+}
+
+
+/* set_fen() sets the board to the position in fen, which is in
+   Forsyth-Edwards Notation, e.g., the initial position is
+   "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1". The move
+   counters at the end are optional (EPD positions don't have them),
+   and anything after them is ignored. If fen doesn't make sense,
+   set_fen() returns FALSE and leaves the board alone. That includes
+   positions that can't come up in a game, where the move generator
+   and the search would go wrong: a pawn on the first or last rank
+   (e.g., "P3k3/8/8/8/8/8/8/4K3 w - - 0 1") or the side that isn't to
+   move in check (e.g., "4k3/4R3/8/8/8/8/8/4K3 w - - 0 1"). */
+
+BOOL set_fen(engine_t *e, char *fen)
+{
+	int c[64], p[64];
+	int sq, i, side, castle, ep, fifty;
+	int kings[2];
+	char *s = fen;
+	int old_c[64], old_p[64];  /* the old position, in case we need it back */
+	int old_side, old_castle, old_ep, old_fifty, old_hply;
+	BOOL old_fen_start;
+
+	for (i = 0; i < 64; ++i) {
+		c[i] = EMPTY;
+		p[i] = EMPTY;
+	}
+	kings[LIGHT] = 0;
+	kings[DARK] = 0;
+
+	/* the pieces, from a8 to h1 */
+	while (*s == ' ')
+		++s;
+	for (sq = 0; *s && *s != ' '; ++s) {
+		if (*s == '/')
+			continue;
+		if (*s >= '1' && *s <= '8') {
+			sq += *s - '0';
+			continue;
+		}
+		for (i = 0; i < 6; ++i)
+			if (toupper(*s) == piece_char[i])
+				break;
+		if (i == 6 || sq > 63)
+			return FALSE;
+		if (i == PAWN && (ROW(sq) == 0 || ROW(sq) == 7))
+			return FALSE;
+		c[sq] = isupper(*s) ? LIGHT : DARK;
+		p[sq] = i;
+		if (i == KING)
+			++kings[c[sq]];
+		++sq;
+	}
+	if (sq != 64 || kings[LIGHT] != 1 || kings[DARK] != 1)
+		return FALSE;
+
+	/* the side to move */
+	while (*s == ' ')
+		++s;
+	if (*s == 'w')
+		side = LIGHT;
+	else if (*s == 'b')
+		side = DARK;
+	else
+		return FALSE;
+	++s;
+
+	/* the castle permissions. we only keep the ones where the king
+	   and rook are where they should be. */
+	while (*s == ' ')
+		++s;
+	castle = 0;
+	for (; *s && *s != ' '; ++s)
+		switch (*s) {
+			case 'K':
+				castle |= 1;
+				break;
+			case 'Q':
+				castle |= 2;
+				break;
+			case 'k':
+				castle |= 4;
+				break;
+			case 'q':
+				castle |= 8;
+				break;
+			case '-':
+				break;
+			default:
+				return FALSE;
+		}
+	if (c[E1] != LIGHT || p[E1] != KING)
+		castle &= ~3;
+	if (c[H1] != LIGHT || p[H1] != ROOK)
+		castle &= ~1;
+	if (c[A1] != LIGHT || p[A1] != ROOK)
+		castle &= ~2;
+	if (c[E8] != DARK || p[E8] != KING)
+		castle &= ~12;
+	if (c[H8] != DARK || p[H8] != ROOK)
+		castle &= ~4;
+	if (c[A8] != DARK || p[A8] != ROOK)
+		castle &= ~8;
+
+	/* the en passant square. it has to be behind a pawn that could
+	   have just moved two squares. */
+	while (*s == ' ')
+		++s;
 	ep = -1;
+	if (*s >= 'a' && *s <= 'h' && s[1] >= '1' && s[1] <= '8') {
+		ep = (s[0] - 'a') + 8 * (8 - (s[1] - '0'));
+		s += 2;
+		if (side == LIGHT ? ROW(ep) != 2 || c[ep + 8] != DARK || p[ep + 8] != PAWN :
+				ROW(ep) != 5 || c[ep - 8] != LIGHT || p[ep - 8] != PAWN)
+			ep = -1;
+	}
+	else if (*s == '-')
+		++s;
+
+	/* the halfmove clock, if it's there */
 	fifty = 0;
-	ply = 0;
-	hply = 0;
-	set_hash();  /* init_hash() must be called before this function */
-	first_move[0] = 0;
+	while (*s == ' ')
+		++s;
+	if (isdigit(*s))
+		fifty = atoi(s);
+
+	for (i = 0; i < 64; ++i) {
+		old_c[i] = e->color[i];
+		old_p[i] = e->piece[i];
+		e->color[i] = c[i];
+		e->piece[i] = p[i];
+	}
+	old_side = e->side;
+	old_castle = e->castle;
+	old_ep = e->ep;
+	old_fifty = e->fifty;
+	old_hply = e->hply;
+	old_fen_start = e->fen_start;
+	e->side = side;
+	e->xside = side ^ 1;
+	e->castle = castle;
+	e->ep = ep;
+	e->fifty = fifty;
+	e->ply = 0;
+	e->hply = 0;
+	e->fen_start = TRUE;
+	set_bitboards(e);
+
+	/* the side to move could capture the other king, so this can't
+	   be a real position. put the old one back. */
+	if (in_check(e, e->xside)) {
+		for (i = 0; i < 64; ++i) {
+			e->color[i] = old_c[i];
+			e->piece[i] = old_p[i];
+		}
+		e->side = old_side;
+		e->xside = old_side ^ 1;
+		e->castle = old_castle;
+		e->ep = old_ep;
+		e->fifty = old_fifty;
+		e->hply = old_hply;
+		e->fen_start = old_fen_start;
+		set_bitboards(e);
+		return FALSE;
+	}
+	set_hash(e);
+	e->first_move[0] = 0;
+	return TRUE;
+}
+
+
+/* new_engine() creates an engine with the initial position and
+   a transposition table of hash_mb megabytes. (Helper engines are
+   created with a hash_mb of 0, because they use their master's
+   table.) */
+
+engine_t *new_engine(int hash_mb)
+{
+	engine_t *e;
+
+	e = (engine_t *)calloc(1, sizeof(engine_t));
+	if (!e) {
+		printf("Can't allocate an engine.\n");
+		exit(1);
+	}
+	if (hash_mb) {
+		e->tt = (tt_t *)calloc(1, sizeof(tt_t));
+		if (!e->tt) {
+			printf("Can't allocate the hash table.\n");
+			exit(1);
+		}
+		alloc_tt(e->tt, hash_mb);
+	}
+	e->max_time = 1 << 25;
+	e->max_depth = 4;
+	e->max_nodes = 0;
+	e->selective = SEL_ALL;
+	e->multipv = 1;
+	e->threads = 1;
+	e->book_rand = (((U64)time(NULL) << 16) ^ (U64)(size_t)e) | 1;  /* never 0 */
+	init_board(e);
+	return e;
+}
+
+
+/* free_engine() frees an engine, its helpers, and its transposition
+   table. */
+
+void free_engine(engine_t *e)
+{
+	int i;
+
+	for (i = 1; i < MAX_THREADS; ++i)
+		if (e->helper[i])
+			free_engine(e->helper[i]);
+	if (!e->master && e->tt) {
+		free(e->tt->entry);
+		free(e->tt);
+	}
+	free(e);
+}
+
+
+/* get_helper() returns engine e's helper number i, creating it if it
+   doesn't exist yet. */
+
+engine_t *get_helper(engine_t *e, int i)
+{
+	if (!e->helper[i]) {
+		e->helper[i] = new_engine(0);
+		e->helper[i]->tt = e->tt;
+		e->helper[i]->master = e;
+		e->helper[i]->id = i;
+	}
+	return e->helper[i];
+}
+
+
+/* copy_position() sets up engine to with the position (and the game
+   that led to it) of engine from. */
+
+void copy_position(engine_t *to, engine_t *from)
+{
+	memcpy(to->color, from->color, sizeof(from->color));
+	memcpy(to->piece, from->piece, sizeof(from->piece));
+	memcpy(to->bb_piece, from->bb_piece, sizeof(from->bb_piece));
+	memcpy(to->bb_color, from->bb_color, sizeof(from->bb_color));
+	to->bb_all = from->bb_all;
+	memcpy(to->piece_mat, from->piece_mat, sizeof(from->piece_mat));
+	memcpy(to->pawn_mat, from->pawn_mat, sizeof(from->pawn_mat));
+	memcpy(to->pcsq, from->pcsq, sizeof(from->pcsq));
+	to->side = from->side;
+	to->xside = from->xside;
+	to->castle = from->castle;
+	to->ep = from->ep;
+	to->fifty = from->fifty;
+	to->hash = from->hash;
+	to->pawn_hash = from->pawn_hash;
+	to->ply = 0;
+	to->hply = from->hply;
+	memcpy(to->hist_dat, from->hist_dat, from->hply * sizeof(hist_t));
+	to->first_move[0] = 0;
 }
 
 
@@ -40,7 +309,6 @@ void init_hash()
 {
 	int i, j, k;
 
-	srand(0);
 	for (i = 0; i < 2; ++i)
 		for (j = 0; j < 6; ++j)
 			for (k = 0; k < 64; ++k)
@@ -48,300 +316,431 @@ void init_hash()
 	hash_side = hash_rand();
 	for (i = 0; i < 64; ++i)
 		hash_ep[i] = hash_rand();
+	for (i = 0; i < 16; ++i)
+		hash_castle[i] = hash_rand();
 }
 
 
-/* hash_rand() XORs some shifted random numbers together to make sure
-   we have good coverage of all 32 bits. (rand() returns 16-bit numbers
-   on some systems.) */
+/* hash_rand() returns a 64-bit random number. We don't use rand()
+   because it returns as few as 15 bits on some systems and a
+   different sequence on every system; this is a simple "xorshift"
+   generator that gives the same numbers everywhere. */
 
-int hash_rand()
+U64 hash_rand()
 {
-	int i;
-	int r = 0;
+	static U64 r = 1070372;
 
-	for (i = 0; i < 32; ++i)
-		r ^= rand() << i;
-	return r;
+	r ^= r >> 12;
+	r ^= r << 25;
+	r ^= r >> 27;
+	return r * 2685821657736338717ULL;
 }
 
 
 /* set_hash() uses the Zobrist method of generating a unique number (hash)
    for the current chess position. Of course, there are many more chess
-   positions than there are 32 bit numbers, so the numbers generated are
+   positions than there are 64 bit numbers, so the numbers generated are
    not really unique, but they're unique enough for our purposes (to detect
-   repetitions of the position).
+   repetitions of the position and to find positions in the transposition
+   table).
    The way it works is to XOR random numbers that correspond to features of
    the position, e.g., if there's a black knight on B8, hash is XORed with
    hash_piece[BLACK][KNIGHT][B8]. All of the pieces are XORed together,
-   hash_side is XORed if it's black's move, and the en passant square is
-   XORed if there is one. (A chess technicality is that one position can't
-   be a repetition of another if the en passant state is different.) */
-
-void set_hash()
+   hash_side is XORed if it's black's move, the castle permissions are
+   XORed in, and the en passant square is XORed if there is one. (A chess
+   technicality is that one position can't be a repetition of another if
+   the castle permissions or en passant state are different.)
+   Since XOR undoes itself, makemove() doesn't need to call this function;
+   it just XORs out the features that a move changes and XORs in the new
+   ones. set_hash() is only needed when we set up a new position.
+   pawn_hash is made the same way, but only from the pawns. eval() uses
+   it to look up the pawn structure in the pawn hash table. */
+
+void set_hash(engine_t *e)
 {
 	int i;
 
-	hash = 0;
+	e->hash = 0;
+	e->pawn_hash = 0;
 	for (i = 0; i < 64; ++i)
-		if (color[i] != EMPTY)
-			hash ^= hash_piece[color[i]][piece[i]][i];
-	if (side == DARK)
-		hash ^= hash_side;
-	if (ep != -1)
-		hash ^= hash_ep[ep];
+		if (e->color[i] != EMPTY) {
+			e->hash ^= hash_piece[e->color[i]][e->piece[i]][i];
+			if (e->piece[i] == PAWN)
+				e->pawn_hash ^= hash_piece[e->color[i]][PAWN][i];
+		}
+	if (e->side == DARK)
+		e->hash ^= hash_side;
+	e->hash ^= hash_castle[e->castle];
+	if (e->ep != -1)
+		e->hash ^= hash_ep[e->ep];
 }
 
 
-/* in_check() returns TRUE if side s is in check and FALSE
-   otherwise. It just scans the board to find side s's king
-   and calls attack() to see if it's being attacked. */
+/* set_bitboards() sets up the bitboards from the color and piece
+   arrays. */
 
-BOOL in_check(int s)
+void set_bitboards(engine_t *e)
 {
 	int i;
 
+	memset(e->bb_piece, 0, sizeof(e->bb_piece));
+	e->bb_color[LIGHT] = 0;
+	e->bb_color[DARK] = 0;
+	e->bb_all = 0;
+	e->piece_mat[LIGHT] = 0;
+	e->piece_mat[DARK] = 0;
+	e->pawn_mat[LIGHT] = 0;
+	e->pawn_mat[DARK] = 0;
+	e->pcsq[LIGHT] = 0;
+	e->pcsq[DARK] = 0;
 	for (i = 0; i < 64; ++i)
-		if (piece[i] == KING && color[i] == s)
-			return attack(i, s ^ 1);
-	return TRUE;  /* shouldn't get here */
+		if (e->color[i] != EMPTY)
+			add_piece(e, i, e->color[i], e->piece[i]);
 }
 
 
-/* attack() returns TRUE if square sq is being attacked by side
-   s and FALSE otherwise. */
+/* add_piece() and remove_piece() put a piece on a square and take it
+   off again, keeping the board arrays, the bitboards, and the material
+   and piece/square sums in step. Since makemove() and takeback() move
+   the pieces with these functions, eval() never has to add up the
+   material or the piece/square values itself. */
 
-BOOL attack(int sq, int s)
+void add_piece(engine_t *e, int sq, int c, int p)
 {
-	int i, j, n;
+	e->color[sq] = c;
+	e->piece[sq] = p;
+	e->bb_piece[c][p] |= BIT(sq);
+	e->bb_color[c] |= BIT(sq);
+	e->bb_all |= BIT(sq);
+	if (p == PAWN)
+		e->pawn_mat[c] += piece_value[PAWN];
+	else
+		e->piece_mat[c] += piece_value[p];
+	e->pcsq[c] += piece_pcsq[c][p][sq];
+}
 
-	for (i = 0; i < 64; ++i)
-	{
-		if (color[i] == s) {
-			if (piece[i] == PAWN) {
-				if (s == LIGHT) {
-					if (COL(i) != 0 && i - 9 == sq)
-						return TRUE;
-					if (COL(i) != 7 && i - 7 == sq)
-						return TRUE;
-				}
-				else {
-					if (COL(i) != 0 && i + 7 == sq)
-						return TRUE;
-					if (COL(i) != 7 && i + 9 == sq)
-						return TRUE;
-				}
-			}
-			else
-			{
-				for (j = 0; j < offsets[piece[i]]; ++j)
-				{
-					for (n = i;;) {
-						n = mailbox[mailbox64[n] + offset[piece[i]][j]];
-						if (n == -1)
-							break;
-						if (n == sq)
-							return TRUE;
-						if (color[n] != EMPTY)
-							break;
-						if (!slide[piece[i]])
-							break;
-					}
-				}
-			}
-		}
-	}
+void remove_piece(engine_t *e, int sq)
+{
+	int c = e->color[sq];
+	int p = e->piece[sq];
+
+	e->bb_piece[c][p] &= ~BIT(sq);
+	e->bb_color[c] &= ~BIT(sq);
+	e->bb_all &= ~BIT(sq);
+	if (p == PAWN)
+		e->pawn_mat[c] -= piece_value[PAWN];
+	else
+		e->piece_mat[c] -= piece_value[p];
+	e->pcsq[c] -= piece_pcsq[c][p][sq];
+	e->color[sq] = EMPTY;
+	e->piece[sq] = EMPTY;
+}
+
+
+/* in_check() returns TRUE if side s is in check and FALSE
+   otherwise. It finds side s's king in its bitboard and calls
+   attack() to see if it's being attacked. */
+
+BOOL in_check(engine_t *e, int s)
+{
+	if (!e->bb_piece[s][KING])
+		return TRUE;  /* shouldn't get here */
+	return attack(e, LSB(e->bb_piece[s][KING]), s ^ 1);
+}
+
+
+/* attack() returns TRUE if square sq is being attacked by side
+   s and FALSE otherwise. Instead of looking at what each of side s's
+   pieces attacks, it looks at what each kind of piece would attack
+   from square sq; if that hits one of side s's pieces of the same
+   kind, that piece attacks sq. (For pawns we have to look from the
+   other side's point of view, since pawns only attack forward.) */
+
+BOOL attack(engine_t *e, int sq, int s)
+{
+	if (pawn_attacks[s ^ 1][sq] & e->bb_piece[s][PAWN])
+		return TRUE;
+	if (knight_attacks[sq] & e->bb_piece[s][KNIGHT])
+		return TRUE;
+	if (king_attacks[sq] & e->bb_piece[s][KING])
+		return TRUE;
+	if (BISHOP_ATTACKS(sq, e->bb_all) & (e->bb_piece[s][BISHOP] | e->bb_piece[s][QUEEN]))
+		return TRUE;
+	if (ROOK_ATTACKS(sq, e->bb_all) & (e->bb_piece[s][ROOK] | e->bb_piece[s][QUEEN]))
+		return TRUE;
 	return FALSE;
 }
 
 
-void genCastles()
+/* attackers() returns the pieces of both sides that attack square sq
+   if the occupied squares are occ. Pieces that aren't in occ still
+   show up (see() removes them), but sliders are blocked only by the
+   squares in occ, so taking a piece out of occ uncovers the pieces
+   behind it. */
+
+U64 attackers(engine_t *e, int sq, U64 occ)
 {
-	if (side == LIGHT) {
-		if (castle & 1)
-			gen_push(E1, G1, 2);
-		if (castle & 2)
-			gen_push(E1, C1, 2);
-	}
-	else {
-		if (castle & 4)
-			gen_push(E8, G8, 2);
-		if (castle & 8)
-			gen_push(E8, C8, 2);
-	}
+	return (pawn_attacks[DARK][sq] & e->bb_piece[LIGHT][PAWN]) |
+		(pawn_attacks[LIGHT][sq] & e->bb_piece[DARK][PAWN]) |
+		(knight_attacks[sq] & (e->bb_piece[LIGHT][KNIGHT] | e->bb_piece[DARK][KNIGHT])) |
+		(king_attacks[sq] & (e->bb_piece[LIGHT][KING] | e->bb_piece[DARK][KING])) |
+		(BISHOP_ATTACKS(sq, occ) & (e->bb_piece[LIGHT][BISHOP] | e->bb_piece[DARK][BISHOP] |
+			e->bb_piece[LIGHT][QUEEN] | e->bb_piece[DARK][QUEEN])) |
+		(ROOK_ATTACKS(sq, occ) & (e->bb_piece[LIGHT][ROOK] | e->bb_piece[DARK][ROOK] |
+			e->bb_piece[LIGHT][QUEEN] | e->bb_piece[DARK][QUEEN]));
 }
 
-void genEnPassant()
+
+/* see() is the static exchange evaluator. It returns how much
+   material the side to move wins (or loses, if it's negative) by
+   making the capture m and then letting both sides recapture on m's
+   to square, always with their least valuable piece, for as long as
+   that's good for them. It doesn't look at pins or checks, so it's
+   only an estimate, but it's a lot faster than searching.
+
+   gain[d] is the material the side making capture d has won if the
+   other side stops recapturing there. When we've run out of captures,
+   we go backward through gain[], letting each side pick the better of
+   recapturing or stopping. */
+
+int see(engine_t *e, move m)
 {
-	if (ep != -1) {
-		if (side == LIGHT) {
-			if (COL(ep) != 0 && color[ep + 7] == LIGHT && piece[ep + 7] == PAWN)
-				gen_push(ep + 7, ep, 21);
-			if (COL(ep) != 7 && color[ep + 9] == LIGHT && piece[ep + 9] == PAWN)
-				gen_push(ep + 9, ep, 21);
-		}
-		else {
-			if (COL(ep) != 0 && color[ep - 9] == DARK && piece[ep - 9] == PAWN)
-				gen_push(ep - 9, ep, 21);
-			if (COL(ep) != 7 && color[ep - 7] == DARK && piece[ep - 7] == PAWN)
-				gen_push(ep - 7, ep, 21);
-		}
+	int gain[32];
+	int d = 0;
+	int to = m.b.to;
+	int s = e->side;  /* the side making the next capture */
+	int p;  /* the piece that's on square to */
+	int a;  /* the piece that captures it */
+	U64 occ, att, b;
+
+	occ = e->bb_all ^ BIT(m.b.from);
+	if (m.b.bits & 4) {
+		gain[0] = piece_value[PAWN];
+		occ ^= BIT(to + (s == LIGHT ? 8 : -8));
+	}
+	else if (e->color[to] != EMPTY)
+		gain[0] = piece_value[e->piece[to]];
+	else
+		gain[0] = 0;
+	p = e->piece[(int)m.b.from];
+	if (m.b.bits & 32) {
+		gain[0] += piece_value[(int)m.b.promote] - piece_value[PAWN];
+		p = m.b.promote;
 	}
+	att = attackers(e, to, occ) & occ;
+	for (;;) {
+		s ^= 1;
+		b = att & e->bb_color[s];
+		if (!b)
+			break;
+
+		/* find the least valuable attacker */
+		for (a = PAWN; a < KING; ++a)
+			if (b & e->bb_piece[s][a])
+				break;
+
+		/* a king can't capture if the square is still defended */
+		if (a == KING && (att & e->bb_color[s ^ 1]))
+			break;
+		++d;
+		gain[d] = piece_value[p] - gain[d - 1];
+		p = a;
+		occ ^= BIT(LSB(b & e->bb_piece[s][a]));
+		att = attackers(e, to, occ) & occ;
+	}
+	while (d) {
+		if (gain[d] > -gain[d - 1])
+			gain[d - 1] = -gain[d];
+		--d;
+	}
+	return gain[0];
 }
 
-void genPawn(int i)
+
+void genCastles(engine_t *e)
 {
-	if (side == LIGHT) {
-		if (COL(i) != 0 && color[i - 9] == DARK)
-			gen_push(i, i - 9, 17);
-		if (COL(i) != 7 && color[i - 7] == DARK)
-			gen_push(i, i - 7, 17);
-		if (color[i - 8] == EMPTY) {
-			gen_push(i, i - 8, 16);
-			if (i >= 48 && color[i - 16] == EMPTY)
-				gen_push(i, i - 16, 24);
-		}
+	if (e->side == LIGHT) {
+		if (e->castle & 1)
+			gen_push(e, E1, G1, 2);
+		if (e->castle & 2)
+			gen_push(e, E1, C1, 2);
 	}
 	else {
-		if (COL(i) != 0 && color[i + 7] == LIGHT)
-			gen_push(i, i + 7, 17);
-		if (COL(i) != 7 && color[i + 9] == LIGHT)
-			gen_push(i, i + 9, 17);
-		if (color[i + 8] == EMPTY) {
-			gen_push(i, i + 8, 16);
-			if (i <= 15 && color[i + 16] == EMPTY)
-				gen_push(i, i + 16, 24);
-		}
+		if (e->castle & 4)
+			gen_push(e, E8, G8, 2);
+		if (e->castle & 8)
+			gen_push(e, E8, C8, 2);
 	}
 }
 
-void genPiece(int i)
+void genEnPassant(engine_t *e)
 {
-	for (int j = 0; j < offsets[piece[i]]; ++j)
-	{
-		int n = i;
-		while (1) {
-			n = mailbox[mailbox64[n] + offset[piece[i]][j]];
-			if (n == -1)
-				break;
-			if (color[n] == EMPTY) {
-				gen_push(i, n, 0);
-				if (!slide[piece[i]])
-					break;
-			}
-			else {
-				if (color[n] == xside)
-					gen_push(i, n, 1);
-				break;
-			}
+	U64 b;
+
+	/* the pawns that can capture en passant are the ones that an
+	   enemy pawn on the en passant square would attack */
+	if (e->ep != -1)
+		for (b = pawn_attacks[e->xside][e->ep] & e->bb_piece[e->side][PAWN]; b; b &= b - 1)
+			gen_push(e, LSB(b), e->ep, 21);
+}
+
+/* genPawn() generates the moves of the pawn on square i. what is
+   GEN_CAPS, GEN_QUIETS, or GEN_ALL (see defs.h); a push to the last
+   rank counts as a capture, because it's a promotion. */
+
+void genPawn(engine_t *e, int i, int what)
+{
+	U64 a;
+	int n;
+	int dir = e->side == LIGHT ? -8 : 8;
+
+	if (what & GEN_CAPS)
+		for (a = pawn_attacks[e->side][i] & e->bb_color[e->xside]; a; a &= a - 1)
+			gen_push(e, i, LSB(a), 17);
+	n = i + dir;
+	if (e->color[n] == EMPTY) {
+		if (n <= H8 || n >= A1) {
+			if (what & GEN_CAPS)
+				gen_push(e, i, n, 16);
+		}
+		else if (what & GEN_QUIETS) {
+			gen_push(e, i, n, 16);
+			if ((e->side == LIGHT ? i >= 48 : i <= 15) &&
+					e->color[n + dir] == EMPTY)
+				gen_push(e, i, n + dir, 24);
 		}
 	}
 }
 
-void genSidePiece(int i)
+/* genPiece() generates the moves of the knight, bishop, rook, queen,
+   or king (p) on square i to the squares in target. */
+
+void genPiece(engine_t *e, int i, int p, U64 target)
 {
-	if (piece[i] == PAWN) {
-		genPawn(i);
+	U64 a;
+	int n;
 
+	switch (p) {
+		case KNIGHT:
+			a = knight_attacks[i];
+			break;
+		case BISHOP:
+			a = BISHOP_ATTACKS(i, e->bb_all);
+			break;
+		case ROOK:
+			a = ROOK_ATTACKS(i, e->bb_all);
+			break;
+		case QUEEN:
+			a = BISHOP_ATTACKS(i, e->bb_all) | ROOK_ATTACKS(i, e->bb_all);
+			break;
+		default:
+			a = king_attacks[i];
+			break;
 	}
-	else
-	{
-		genPiece(i);
-
+	for (a &= target; a; a &= a - 1) {
+		n = LSB(a);
+		gen_push(e, i, n, e->color[n] == EMPTY ? 0 : 1);
 	}
-
 }
 
-void genMoves()
-{
+/* genMoves() goes through the friendly pieces and generates their
+   moves. what is GEN_CAPS, GEN_QUIETS, or GEN_ALL. The piece bitboards
+   work as piece lists: we go through them one kind of piece at a time,
+   so we only visit squares that have pieces on them, and we never have
+   to look up what kind of piece is on a square. */
 
-	for (int i = 0; i < 64; ++i)
-	{
-		if (color[i] == side) {
-			genSidePiece(i);
-		}
-
-	}
+void genMoves(engine_t *e, int what)
+{
+	U64 b;
+	U64 target = 0;
+	int p;
+
+	if (what & GEN_CAPS)
+		target |= e->bb_color[e->xside];
+	if (what & GEN_QUIETS)
+		target |= ~e->bb_all;
+	for (p = KNIGHT; p <= KING; ++p)
+		for (b = e->bb_piece[e->side][p]; b; b &= b - 1)
+			genPiece(e, LSB(b), p, target);
+	for (b = e->bb_piece[e->side][PAWN]; b; b &= b - 1)
+		genPawn(e, LSB(b), what);
 }
 
 /* gen() generates pseudo-legal moves for the current position.
-   It scans the board to find friendly pieces and then determines
-   what squares they attack. When it finds a piece/square
+   It goes through the friendly pieces and looks up what squares
+   they attack. When it finds a piece/square
    combination, it calls gen_push to put the move on the "move
    stack." */
 
-void gen()
+void gen(engine_t *e)
 {
 	/* so far, we have no moves for the current ply */
-	first_move[ply + 1] = first_move[ply];
-	genMoves();
+	e->first_move[e->ply + 1] = e->first_move[e->ply];
+	genMoves(e, GEN_ALL);
 
 	/* generate castle moves */
-	genCastles();
+	genCastles(e);
 	/* generate en passant moves */
-	genEnPassant();
+	genEnPassant(e);
 
 }
 
 
 /* gen_caps() is basically a copy of gen() that's modified to
    only generate capture and promote moves. It's used by the
-   quiescence search. */
+   quiescence search and the move picker. */
 
-void gen_caps()
+void gen_caps(engine_t *e)
 {
-	int i, j, n;
+	e->first_move[e->ply + 1] = e->first_move[e->ply];
+	genMoves(e, GEN_CAPS);
+	genEnPassant(e);
+}
 
-	first_move[ply + 1] = first_move[ply];
-	for (i = 0; i < 64; ++i)
-		if (color[i] == side) {
-			if (piece[i] == PAWN) {
-				if (side == LIGHT) {
-					if (COL(i) != 0 && color[i - 9] == DARK)
-						gen_push(i, i - 9, 17);
-					if (COL(i) != 7 && color[i - 7] == DARK)
-						gen_push(i, i - 7, 17);
-					if (i <= 15 && color[i - 8] == EMPTY)
-						gen_push(i, i - 8, 16);
-				}
-				if (side == DARK) {
-					if (COL(i) != 0 && color[i + 7] == LIGHT)
-						gen_push(i, i + 7, 17);
-					if (COL(i) != 7 && color[i + 9] == LIGHT)
-						gen_push(i, i + 9, 17);
-					if (i >= 48 && color[i + 8] == EMPTY)
-						gen_push(i, i + 8, 16);
-				}
-			}
-			else
-				for (j = 0; j < offsets[piece[i]]; ++j)
-					for (n = i;;) {
-						n = mailbox[mailbox64[n] + offset[piece[i]][j]];
-						if (n == -1)
-							break;
-						if (color[n] != EMPTY) {
-							if (color[n] == xside)
-								gen_push(i, n, 1);
-							break;
-						}
-						if (!slide[piece[i]])
-							break;
-					}
-		}
-	if (ep != -1) {
-		if (side == LIGHT) {
-			if (COL(ep) != 0 && color[ep + 7] == LIGHT && piece[ep + 7] == PAWN)
-				gen_push(ep + 7, ep, 21);
-			if (COL(ep) != 7 && color[ep + 9] == LIGHT && piece[ep + 9] == PAWN)
-				gen_push(ep + 9, ep, 21);
-		}
-		else {
-			if (COL(ep) != 0 && color[ep - 9] == DARK && piece[ep - 9] == PAWN)
-				gen_push(ep - 9, ep, 21);
-			if (COL(ep) != 7 && color[ep - 7] == DARK && piece[ep - 7] == PAWN)
-				gen_push(ep - 7, ep, 21);
-		}
+
+/* gen_quiets() adds the moves that gen_caps() leaves out to the
+   current ply's move list. The move picker calls it after it's
+   tried the captures. */
+
+void gen_quiets(engine_t *e)
+{
+	genMoves(e, GEN_QUIETS);
+	genCastles(e);
+}
+
+
+/* move_ok() returns TRUE if m is one of the moves that gen() would
+   generate in the current position. It's used to check moves that
+   weren't generated here, like hash moves and killer moves, before
+   they're given to makemove(). It generates the moves of the piece
+   on m's from square past the end of the current ply's move list
+   and looks for m among them. */
+
+BOOL move_ok(engine_t *e, move m)
+{
+	int from = m.b.from;
+	int end = e->first_move[e->ply + 1];
+	int i;
+	BOOL ok = FALSE;
+
+	if (!m.u || from < 0 || from > 63 || e->color[from] != e->side)
+		return FALSE;
+	if (e->piece[from] == PAWN) {
+		genPawn(e, from, GEN_ALL);
+		genEnPassant(e);
 	}
+	else {
+		genPiece(e, from, e->piece[from], ~e->bb_color[e->side]);
+		if (e->piece[from] == KING)
+			genCastles(e);
+	}
+	for (i = end; i < e->first_move[e->ply + 1]; ++i)
+		if (e->gen_dat[i].m.u == m.u) {
+			ok = TRUE;
+			break;
+		}
+	e->first_move[e->ply + 1] = end;
+	return ok;
 }
 
 
@@ -354,46 +753,46 @@ void gen_caps()
    1,000,000 is added to a capture move's score, so it
    always gets ordered above a "normal" move. */
 
-void gen_push(int from, int to, int bits)
+void gen_push(engine_t *e, int from, int to, int bits)
 {
 	gen_t *g;
 
 	if (bits & 16) {
-		if (side == LIGHT) {
+		if (e->side == LIGHT) {
 			if (to <= H8) {
-				gen_promote(from, to, bits);
+				gen_promote(e, from, to, bits);
 				return;
 			}
 		}
 		else {
 			if (to >= A1) {
-				gen_promote(from, to, bits);
+				gen_promote(e, from, to, bits);
 				return;
 			}
 		}
 	}
-	g = &gen_dat[first_move[ply + 1]++];
+	g = &e->gen_dat[e->first_move[e->ply + 1]++];
 	g->m.b.from = (char)from;
 	g->m.b.to = (char)to;
 	g->m.b.promote = 0;
 	g->m.b.bits = (char)bits;
-	if (color[to] != EMPTY)
-		g->score = 1000000 + (piece[to] * 10) - piece[from];
+	if (e->color[to] != EMPTY)
+		g->score = 1000000 + (e->piece[to] * 10) - e->piece[from];
 	else
-		g->score = history[from][to];
+		g->score = e->history[from][to];
 }
 
 
 /* gen_promote() is just like gen_push(), only it puts 4 moves
    on the move stack, one for each possible promotion piece */
 
-void gen_promote(int from, int to, int bits)
+void gen_promote(engine_t *e, int from, int to, int bits)
 {
 	int i;
 	gen_t *g;
 
 	for (i = KNIGHT; i <= QUEEN; ++i) {
-		g = &gen_dat[first_move[ply + 1]++];
+		g = &e->gen_dat[e->first_move[e->ply + 1]++];
 		g->m.b.from = (char)from;
 		g->m.b.to = (char)to;
 		g->m.b.promote = (char)i;
@@ -407,41 +806,41 @@ void gen_promote(int from, int to, int bits)
    undoes whatever it did and returns FALSE. Otherwise, it
    returns TRUE. */
 
-BOOL makemove(move_bytes m)
+BOOL makemove(engine_t *e, move_bytes m)
 {
+	int from, to;  /* the rook's squares if this is a castle move */
+	int p;  /* the piece that ends up on m.to */
 
 	/* test to see if a castle move is legal and move the rook
 	   (the king is moved with the usual move code later) */
 	if (m.bits & 2) {
-		int from, to;
-
-		if (in_check(side))
+		if (in_check(e, e->side))
 			return FALSE;
 		switch (m.to) {
 		case 62:
-			if (color[F1] != EMPTY || color[G1] != EMPTY ||
-				attack(F1, xside) || attack(G1, xside))
+			if (e->color[F1] != EMPTY || e->color[G1] != EMPTY ||
+				attack(e, F1, e->xside) || attack(e, G1, e->xside))
 				return FALSE;
 			from = H1;
 			to = F1;
 			break;
 		case 58:
-			if (color[B1] != EMPTY || color[C1] != EMPTY || color[D1] != EMPTY ||
-				attack(C1, xside) || attack(D1, xside))
+			if (e->color[B1] != EMPTY || e->color[C1] != EMPTY || e->color[D1] != EMPTY ||
+				attack(e, C1, e->xside) || attack(e, D1, e->xside))
 				return FALSE;
 			from = A1;
 			to = D1;
 			break;
 		case 6:
-			if (color[F8] != EMPTY || color[G8] != EMPTY ||
-				attack(F8, xside) || attack(G8, xside))
+			if (e->color[F8] != EMPTY || e->color[G8] != EMPTY ||
+				attack(e, F8, e->xside) || attack(e, G8, e->xside))
 				return FALSE;
 			from = H8;
 			to = F8;
 			break;
 		case 2:
-			if (color[B8] != EMPTY || color[C8] != EMPTY || color[D8] != EMPTY ||
-				attack(C8, xside) || attack(D8, xside))
+			if (e->color[B8] != EMPTY || e->color[C8] != EMPTY || e->color[D8] != EMPTY ||
+				attack(e, C8, e->xside) || attack(e, D8, e->xside))
 				return FALSE;
 			from = A8;
 			to = D8;
@@ -451,101 +850,119 @@ BOOL makemove(move_bytes m)
 			to = -1;
 			break;
 		}
-		color[to] = color[from];
-		piece[to] = piece[from];
-		color[from] = EMPTY;
-		piece[from] = EMPTY;
+		remove_piece(e, from);
+		add_piece(e, to, e->side, ROOK);
 	}
 
 	/* back up information so we can take the move back later. */
-	hist_dat[hply].m.b = m;
-	hist_dat[hply].capture = piece[(int)m.to];
-	hist_dat[hply].castle = castle;
-	hist_dat[hply].ep = ep;
-	hist_dat[hply].fifty = fifty;
-	hist_dat[hply].hash = hash;
-	++ply;
-	++hply;
+	e->hist_dat[e->hply].m.b = m;
+	e->hist_dat[e->hply].capture = e->piece[(int)m.to];
+	e->hist_dat[e->hply].castle = e->castle;
+	e->hist_dat[e->hply].ep = e->ep;
+	e->hist_dat[e->hply].fifty = e->fifty;
+	e->hist_dat[e->hply].hash = e->hash;
+	e->hist_dat[e->hply].pawn_hash = e->pawn_hash;
+	++e->ply;
+	++e->hply;
 
 	/* update the castle, en passant, and
-	   fifty-move-draw variables */
-	castle &= castle_mask[(int)m.from] & castle_mask[(int)m.to];
+	   fifty-move-draw variables, XORing the old values
+	   out of the hash key and the new ones in */
+	e->hash ^= hash_castle[e->castle];
+	if (e->ep != -1)
+		e->hash ^= hash_ep[e->ep];
+	e->castle &= castle_mask[(int)m.from] & castle_mask[(int)m.to];
 	if (m.bits & 8) {
-		if (side == LIGHT)
-			ep = m.to + 8;
+		if (e->side == LIGHT)
+			e->ep = m.to + 8;
 		else
-			ep = m.to - 8;
+			e->ep = m.to - 8;
 	}
 	else
-		ep = -1;
+		e->ep = -1;
+	e->hash ^= hash_castle[e->castle];
+	if (e->ep != -1)
+		e->hash ^= hash_ep[e->ep];
 	if (m.bits & 17)
-		fifty = 0;
+		e->fifty = 0;
 	else
-		++fifty;
+		++e->fifty;
 
 	/* move the piece */
-	color[(int)m.to] = side;
+	p = e->piece[(int)m.from];
+	if (e->hist_dat[e->hply - 1].capture != EMPTY) {
+		e->hash ^= hash_piece[e->xside][e->hist_dat[e->hply - 1].capture][(int)m.to];
+		if (e->hist_dat[e->hply - 1].capture == PAWN)
+			e->pawn_hash ^= hash_piece[e->xside][PAWN][(int)m.to];
+		remove_piece(e, m.to);
+	}
+	e->hash ^= hash_piece[e->side][p][(int)m.from];
+	if (p == PAWN)
+		e->pawn_hash ^= hash_piece[e->side][PAWN][(int)m.from];
+	remove_piece(e, m.from);
 	if (m.bits & 32)
-		piece[(int)m.to] = m.promote;
-	else
-		piece[(int)m.to] = piece[(int)m.from];
-	color[(int)m.from] = EMPTY;
-	piece[(int)m.from] = EMPTY;
+		p = m.promote;
+	add_piece(e, m.to, e->side, p);
+	e->hash ^= hash_piece[e->side][p][(int)m.to];
+	if (p == PAWN)
+		e->pawn_hash ^= hash_piece[e->side][PAWN][(int)m.to];
+	if (m.bits & 2)
+		e->hash ^= hash_piece[e->side][ROOK][from] ^ hash_piece[e->side][ROOK][to];
 
 	/* erase the pawn if this is an en passant move */
 	if (m.bits & 4) {
-		if (side == LIGHT) {
-			color[m.to + 8] = EMPTY;
-			piece[m.to + 8] = EMPTY;
+		if (e->side == LIGHT) {
+			remove_piece(e, m.to + 8);
+			e->hash ^= hash_piece[DARK][PAWN][m.to + 8];
+			e->pawn_hash ^= hash_piece[DARK][PAWN][m.to + 8];
 		}
 		else {
-			color[m.to - 8] = EMPTY;
-			piece[m.to - 8] = EMPTY;
+			remove_piece(e, m.to - 8);
+			e->hash ^= hash_piece[LIGHT][PAWN][m.to - 8];
+			e->pawn_hash ^= hash_piece[LIGHT][PAWN][m.to - 8];
 		}
 	}
 
 	/* switch sides and test for legality (if we can capture
 	   the other guy's king, it's an illegal position and
 	   we need to take the move back) */
-	side ^= 1;
-	xside ^= 1;
-	if (in_check(xside)) {
-		takeback();
+	e->side ^= 1;
+	e->xside ^= 1;
+	e->hash ^= hash_side;
+	if (in_check(e, e->xside)) {
+		takeback(e);
 		return FALSE;
 	}
-	set_hash();
 	return TRUE;
 }
 
 
 /* takeback() is very similar to makemove(), only backwards :)  */
 
-void takeback()
+void takeback(engine_t *e)
 {
 	move_bytes m;
 
-	side ^= 1;
-	xside ^= 1;
-	--ply;
-	--hply;
-	m = hist_dat[hply].m.b;
-	castle = hist_dat[hply].castle;
-	ep = hist_dat[hply].ep;
-	fifty = hist_dat[hply].fifty;
-	hash = hist_dat[hply].hash;
-	color[(int)m.from] = side;
-	if (m.bits & 32)
-		piece[(int)m.from] = PAWN;
-	else
-		piece[(int)m.from] = piece[(int)m.to];
-	if (hist_dat[hply].capture == EMPTY) {
-		color[(int)m.to] = EMPTY;
-		piece[(int)m.to] = EMPTY;
+	e->side ^= 1;
+	e->xside ^= 1;
+	--e->ply;
+	--e->hply;
+	m = e->hist_dat[e->hply].m.b;
+	e->castle = e->hist_dat[e->hply].castle;
+	e->ep = e->hist_dat[e->hply].ep;
+	e->fifty = e->hist_dat[e->hply].fifty;
+	e->hash = e->hist_dat[e->hply].hash;
+	e->pawn_hash = e->hist_dat[e->hply].pawn_hash;
+	if (m.bits & 32) {
+		remove_piece(e, m.to);
+		add_piece(e, m.from, e->side, PAWN);
 	}
 	else {
-		color[(int)m.to] = xside;
-		piece[(int)m.to] = hist_dat[hply].capture;
+		add_piece(e, m.from, e->side, e->piece[(int)m.to]);
+		remove_piece(e, m.to);
 	}
+	if (e->hist_dat[e->hply].capture != EMPTY)
+		add_piece(e, m.to, e->xside, e->hist_dat[e->hply].capture);
 	if (m.bits & 2) {
 		int from, to;
 
@@ -571,19 +988,54 @@ void takeback()
 			to = -1;
 			break;
 		}
-		color[to] = side;
-		piece[to] = ROOK;
-		color[from] = EMPTY;
-		piece[from] = EMPTY;
+		remove_piece(e, from);
+		add_piece(e, to, e->side, ROOK);
 	}
 	if (m.bits & 4) {
-		if (side == LIGHT) {
-			color[m.to + 8] = xside;
-			piece[m.to + 8] = PAWN;
-		}
-		else {
-			color[m.to - 8] = xside;
-			piece[m.to - 8] = PAWN;
-		}
+		if (e->side == LIGHT)
+			add_piece(e, m.to + 8, e->xside, PAWN);
+		else
+			add_piece(e, m.to - 8, e->xside, PAWN);
 	}
 }
+
+
+/* make_null() makes a "null move": the side to move passes. That isn't
+   legal, of course, but the search uses it to find out if a position
+   is so good that it's still good after giving the opponent a free move
+   (see search()). take_null() takes it back. A null move is stored in
+   hist_dat as a move of 0, and it resets fifty, so reps() doesn't look
+   for repetitions across it. */
+
+void make_null(engine_t *e)
+{
+	e->hist_dat[e->hply].m.u = 0;
+	e->hist_dat[e->hply].capture = EMPTY;
+	e->hist_dat[e->hply].castle = e->castle;
+	e->hist_dat[e->hply].ep = e->ep;
+	e->hist_dat[e->hply].fifty = e->fifty;
+	e->hist_dat[e->hply].hash = e->hash;
+	e->hist_dat[e->hply].pawn_hash = e->pawn_hash;
+	++e->ply;
+	++e->hply;
+	if (e->ep != -1) {
+		e->hash ^= hash_ep[e->ep];
+		e->ep = -1;
+	}
+	e->fifty = 0;
+	e->side ^= 1;
+	e->xside ^= 1;
+	e->hash ^= hash_side;
+}
+
+
+void take_null(engine_t *e)
+{
+	e->side ^= 1;
+	e->xside ^= 1;
+	--e->ply;
+	--e->hply;
+	e->ep = e->hist_dat[e->hply].ep;
+	e->fifty = e->hist_dat[e->hply].fifty;
+	e->hash = e->hist_dat[e->hply].hash;
+}
@@ -6,101 +6,194 @@
  */
 
 
+/* The opening book is a binary file, book.bin, that's made from the
+   lines of book.txt (see make_book()). It's a list of 16-byte entries,
+   one for each book move of each book position, sorted by the
+   position's key (see book_key()), so book_move() finds the moves of
+   a position with a binary search. Because the key depends only on
+   the position, the book finds its moves no matter which move order
+   reached it.
+
+   book.bin isn't made automatically: "make" makes it (with "tscp
+   makebook"), and so does the makebook command. It has to be made
+   again whenever book.txt changes, which "make" takes care of.
+
+   The layout of an entry is Polyglot's, with all numbers big-endian
+   so the file works on any machine:
+
+   bytes 0-7    the key of the position
+   bytes 8-9    the move: from + 64 * to + 4096 * promote, with the
+                squares and pieces numbered as in the board arrays
+   bytes 10-11  the weight of the move (how many book lines play it)
+   bytes 12-15  unused
+
+   The keys are TSCP's, though, not Polyglot's, so Polyglot books
+   won't work.
+
+   The file is mapped into memory instead of read, so only the pages
+   that the binary searches touch are loaded, and all the engines
+   share them. (windows.h defines BOOL, just like defs.h, so it has to
+   be included first; see thread.c.) */
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
 #include <string.h>
 #include "defs.h"
 #include "data.h"
 #include "protos.h"
 
 
-/* the opening book file, declared here so we don't have to include stdio.h in
-   a header file */
-FILE *book_file;
+#define BOOK_ENTRY		16  /* the size of an entry in bytes */
+
+
+/* an entry of a book that make_book() is putting together */
+typedef struct {
+	U64 key;
+	int move;
+	int weight;
+} book_entry_t;
 
 
-/* open_book() opens the opening book file and initializes the random number
-   generator so we play random book moves. */
+/* the mapped book file (or NULL if there's no book), and its number
+   of entries */
+unsigned char *book_data = NULL;
+int book_entries = 0;
+
+
+/* open_book() maps the opening book file into memory. */
 
 void open_book()
 {
-	srand(time(NULL));
-	book_file = fopen("book.txt", "r");
-	if (!book_file)
+	int size = 0;
+#ifdef _WIN32
+	HANDLE f, m;
+#else
+	int fd;
+	struct stat st;
+#endif
+
+	book_data = NULL;
+	book_entries = 0;
+#ifdef _WIN32
+	f = CreateFileA("book.bin", GENERIC_READ, FILE_SHARE_READ, NULL,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (f != INVALID_HANDLE_VALUE) {
+		size = (int)GetFileSize(f, NULL);
+		m = size > 0 ? CreateFileMapping(f, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+		if (m) {
+			book_data = (unsigned char *)MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(m);
+		}
+		CloseHandle(f);
+	}
+#else
+	fd = open("book.bin", O_RDONLY);
+	if (fd != -1) {
+		if (!fstat(fd, &st) && st.st_size > 0) {
+			size = (int)st.st_size;
+			book_data = (unsigned char *)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+			if (book_data == (unsigned char *)MAP_FAILED)
+				book_data = NULL;
+		}
+		close(fd);
+	}
+#endif
+	if (!book_data) {
 		printf("Opening book missing.\n");
+		return;
+	}
+	book_entries = size / BOOK_ENTRY;
 }
 
 
-/* close_book() closes the book file. This is called when the program exits. */
+/* close_book() unmaps the book file. This is called when the program exits. */
 
 void close_book()
 {
-	if (book_file)
-		fclose(book_file);
-	book_file = NULL;
+	if (book_data) {
+#ifdef _WIN32
+		UnmapViewOfFile(book_data);
+#else
+		munmap(book_data, book_entries * BOOK_ENTRY);
+#endif
+	}
+	book_data = NULL;
+	book_entries = 0;
 }
 
 
 /* book_move() returns a book move (in integer format) or -1 if there is no
    book move. */
 
-int book_move()
+int book_move(engine_t *e)
 {
-	char line[256];
-	char book_line[256];
 	int i, j, m;
+	int lo, hi;
 	int move[50];  /* the possible book moves */
-	int count[50];  /* the number of occurrences of each move */
+	int weight[50];  /* and their weights */
 	int moves = 0;
-	int total_count = 0;
+	int total_weight = 0;
+	unsigned char *p;
+	U64 key;
 
-	if (!book_file || hply > 25)
+	if (!book_data || e->fen_start)
 		return -1;
+	key = book_key(e);
 
-	/* line is a string with the current line, e.g., "e2e4 e7e5 g1f3 " */
-	line[0] = '\0';
-	j = 0;
-	for (i = 0; i < hply; ++i)
-		j += sprintf(line + j, "%s ", move_str(hist_dat[i].m.b));
-
-	/* compare line to each line in the opening book */
-	fseek(book_file, 0, SEEK_SET);
-	while (fgets(book_line, 256, book_file)) {
-		if (book_match(line, book_line)) {
-
-			/* parse the book move that continues the line */
-			m = parse_move(&book_line[strlen(line)]);
-			if (m == -1)
-				continue;
-			m = gen_dat[m].m.u;
-
-			/* add the book move to the move list, or update the move's
-			   count */
-			for (j = 0; j < moves; ++j)
-				if (move[j] == m) {
-					++count[j];
-					break;
-				}
-			if (j == moves) {
-				move[moves] = m;
-				count[moves] = 1;
-				++moves;
-			}
-			++total_count;
-		}
+	/* find the first entry for the position */
+	lo = 0;
+	hi = book_entries;
+	while (lo < hi) {
+		i = (lo + hi) / 2;
+		if (get_bytes(book_data + i * BOOK_ENTRY, 8) < key)
+			lo = i + 1;
+		else
+			hi = i;
+	}
+
+	/* collect the book moves that are legal here (a different position
+	   could have the same key) */
+	gen(e);
+	for (i = lo; i < book_entries && moves < 50; ++i) {
+		p = book_data + i * BOOK_ENTRY;
+		if (get_bytes(p, 8) != key)
+			break;
+		m = (int)get_bytes(p + 8, 2);
+		for (j = e->first_move[0]; j < e->first_move[1]; ++j)
+			if (e->gen_dat[j].m.b.from == (m & 63) &&
+					e->gen_dat[j].m.b.to == ((m >> 6) & 63) &&
+					e->gen_dat[j].m.b.promote == (m >> 12))
+				break;
+		if (j == e->first_move[1] || !get_bytes(p + 10, 2))
+			continue;
+		move[moves] = e->gen_dat[j].m.u;
+		weight[moves] = (int)get_bytes(p + 10, 2);
+		total_weight += weight[moves];
+		++moves;
 	}
 
 	/* no book moves? */
 	if (moves == 0)
 		return -1;
 
-	/* Think of total_count as the set of matching book lines.
-	   Randomly pick one of those lines (j) and figure out which
-	   move j "corresponds" to. */
-	j = rand() % total_count;
+	/* pick a move at random, with the odds of each move proportional
+	   to its weight. the random numbers come from the engine's own
+	   xorshift generator (like hash_rand()'s), not rand(), so engines
+	   on different threads don't share its state. */
+	e->book_rand ^= e->book_rand >> 12;
+	e->book_rand ^= e->book_rand << 25;
+	e->book_rand ^= e->book_rand >> 27;
+	j = (int)(((e->book_rand * 2685821657736338717ULL) >> 32) % total_weight);
 	for (i = 0; i < moves; ++i) {
-		j -= count[i];
+		j -= weight[i];
 		if (j < 0)
 			return move[i];
 	}
@@ -108,14 +201,153 @@ int book_move()
 }
 
 
-/* book_match() returns TRUE if the first part of s2 matches s1. */
+/* make_book() makes the binary book file out of the text book file
+   in, where each line is a sequence of moves from the initial position
+   (e.g., "e2e4 e7e5 g1f3"). Every move of every line becomes a book
+   move of the position it's played in, with a weight of the number of
+   lines that play it there. It returns FALSE if it fails. */
 
-BOOL book_match(char *s1, char *s2)
+BOOL make_book(char *in, char *out)
 {
-	int i;
+	FILE *f;
+	engine_t *e;
+	book_entry_t *entry = NULL, *p;
+	int entries = 0, size = 0;
+	char line[1024];
+	char *s;
+	int i, j, m;
+	U64 key;
+	unsigned char buf[BOOK_ENTRY];
+
+	f = fopen(in, "r");
+	if (!f)
+		return FALSE;
+	e = new_engine(0);
+	while (fgets(line, sizeof(line), f)) {
+		init_board(e);
+		for (s = strtok(line, " \t\r\n"); s; s = strtok(NULL, " \t\r\n")) {
+			gen(e);
+			m = parse_move(e, s);
+			key = book_key(e);
+			if (m == -1 || !makemove(e, e->gen_dat[m].m.b))
+				break;
+			e->ply = 0;
+			if (entries == size) {
+				size = size ? size * 2 : 1024;
+				p = (book_entry_t *)realloc(entry, size * sizeof(book_entry_t));
+				if (!p) {
+					printf("Can't allocate memory for the book.\n");
+					free(entry);
+					free_engine(e);
+					fclose(f);
+					return FALSE;
+				}
+				entry = p;
+			}
+			entry[entries].key = key;
+			entry[entries].move = e->hist_dat[e->hply - 1].m.b.from +
+					64 * e->hist_dat[e->hply - 1].m.b.to +
+					4096 * e->hist_dat[e->hply - 1].m.b.promote;
+			entry[entries].weight = 1;
+			++entries;
+		}
+	}
+	fclose(f);
+	free_engine(e);
+
+	/* sort the entries and merge the ones for the same move of the
+	   same position */
+	qsort(entry, entries, sizeof(book_entry_t), book_compare);
+	for (i = 0, j = -1; i < entries; ++i)
+		if (j >= 0 && entry[i].key == entry[j].key && entry[i].move == entry[j].move) {
+			if (entry[j].weight < 65535)
+				++entry[j].weight;
+		}
+		else
+			entry[++j] = entry[i];
+	entries = j + 1;
 
-	for (i = 0; i < (signed int)strlen(s1); ++i)
-		if (s2[i] == '\0' || s2[i] != s1[i])
-			return FALSE;
+	f = fopen(out, "wb");
+	if (!f) {
+		printf("Can't write %s.\n", out);
+		free(entry);
+		return FALSE;
+	}
+	for (i = 0; i < entries; ++i) {
+		put_bytes(buf, entry[i].key, 8);
+		put_bytes(buf + 8, (U64)entry[i].move, 2);
+		put_bytes(buf + 10, (U64)entry[i].weight, 2);
+		put_bytes(buf + 12, 0, 4);
+		fwrite(buf, BOOK_ENTRY, 1, f);
+	}
+	fclose(f);
+	free(entry);
+	printf("Made %s with %d book moves.\n", out, entries);
 	return TRUE;
 }
+
+
+/* book_key() returns the key of the current position in the book. It's
+   the hash key, except that the en passant square only counts if an en
+   passant capture is legal (like in Polyglot's keys). makemove() sets
+   the en passant square after every double pawn push, so otherwise a
+   position reached with a double push would have a different key than
+   the same position reached with a different move order. */
+
+U64 book_key(engine_t *e)
+{
+	U64 b;
+	move m;
+
+	if (e->ep == -1)
+		return e->hash;
+	for (b = pawn_attacks[e->xside][e->ep] & e->bb_piece[e->side][PAWN]; b; b &= b - 1) {
+		m.b.from = LSB(b);
+		m.b.to = e->ep;
+		m.b.promote = 0;
+		m.b.bits = 21;
+		if (makemove(e, m.b)) {
+			takeback(e);
+			return e->hash;
+		}
+	}
+	return e->hash ^ hash_ep[e->ep];
+}
+
+
+/* book_compare() compares two book entries for qsort(), by key first
+   and move second. */
+
+int book_compare(const void *a, const void *b)
+{
+	const book_entry_t *x = (const book_entry_t *)a;
+	const book_entry_t *y = (const book_entry_t *)b;
+
+	if (x->key != y->key)
+		return x->key < y->key ? -1 : 1;
+	return x->move - y->move;
+}
+
+
+/* get_bytes() returns the big-endian number in the n bytes at p */
+
+U64 get_bytes(unsigned char *p, int n)
+{
+	U64 x = 0;
+	int i;
+
+	for (i = 0; i < n; ++i)
+		x = (x << 8) | p[i];
+	return x;
+}
+
+
+/* put_bytes() puts x in the n bytes at p as a big-endian number */
+
+void put_bytes(unsigned char *p, U64 x, int n)
+{
+	int i;
+
+	for (i = n - 1; i >= 0; --i, x >>= 8)
+		p[i] = (unsigned char)(x & 255);
+}
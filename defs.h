@@ -10,9 +10,26 @@
 #define TRUE			1
 #define FALSE			0
 
+typedef unsigned long long U64;
+
 #define GEN_STACK		1120
 #define MAX_PLY			32
 #define HIST_STACK		400
+#define MAX_THREADS		64
+#define MAX_MULTIPV		64
+#define PAWN_HASH_SIZE	4096  /* entries in the pawn hash table; a power of 2 */
+#define POLL_NS			1000000  /* how often the search checks the clock */
+#define POLL_MIN		64  /* the fewest nodes between checks... */
+#define POLL_MAX		65536  /* ...and the most */
+#define ASPIRATION		35  /* the first aspiration window is this wide on each side */
+
+/* the parts of the selective search that can be switched on and off
+   (see search() and engine_t's selective) */
+#define SEL_NULL		1  /* null-move pruning */
+#define SEL_LMR			2  /* late move reductions */
+#define SEL_FUTILITY	4  /* futility pruning */
+#define SEL_RAZOR		8  /* razoring */
+#define SEL_ALL			15
 
 #define LIGHT			0
 #define DARK			1
@@ -26,6 +43,23 @@
 
 #define EMPTY			6
 
+/* the kinds of moves genMoves() can generate */
+#define GEN_CAPS		1  /* captures and promotions */
+#define GEN_QUIETS		2  /* all other moves except castles */
+#define GEN_ALL			3
+
+/* the stages of the move picker; see next_move() in search.c */
+#define PICK_HASH		0
+#define PICK_GEN_CAPS	1
+#define PICK_GOOD_CAPS	2
+#define PICK_KILLER1	3
+#define PICK_KILLER2	4
+#define PICK_COUNTER	5
+#define PICK_GEN_QUIETS	6
+#define PICK_QUIETS		7
+#define PICK_BAD_CAPS	8
+#define PICK_DONE		9
+
 /* useful squares */
 #define A1				56
 #define B1				57
@@ -48,6 +82,34 @@
 #define COL(x)			(x & 7)
 
 
+/* bitboard macros; see bitboard.c. BIT(sq) is the bitboard with only
+   square sq set, LSB(b) is the lowest square set in b, and POPCOUNT(b)
+   is the number of squares set in b. */
+#define BIT(sq)			(1ULL << (sq))
+
+#ifdef __GNUC__
+#define LSB(b)			__builtin_ctzll(b)
+#define POPCOUNT(b)		__builtin_popcountll(b)
+#else
+#define LSB(b)			lsb(b)
+#define POPCOUNT(b)		popcount(b)
+#endif
+
+/* BISHOP_ATTACKS(sq, occ) and ROOK_ATTACKS(sq, occ) are the squares
+   attacked by a bishop or rook on sq when the squares in occ are
+   occupied. Build with USE_PEXT defined (and BMI2 enabled) to use the
+   PEXT instruction instead of magic multiplication. */
+#ifdef USE_PEXT
+#include <immintrin.h>
+#define PEXT(b, m)		_pext_u64(b, m)
+#define MAGIC_INDEX(m, occ)	PEXT(occ, (m).mask)
+#else
+#define MAGIC_INDEX(m, occ)	((((occ) & (m).mask) * (m).magic) >> (m).shift)
+#endif
+#define BISHOP_ATTACKS(sq, occ)	(bishop_magic[sq].attacks[MAGIC_INDEX(bishop_magic[sq], occ)])
+#define ROOK_ATTACKS(sq, occ)	(rook_magic[sq].attacks[MAGIC_INDEX(rook_magic[sq], occ)])
+
+
 /* This is the basic description of a move. promote is what
    piece to promote the pawn to, if the move is a pawn
    promotion. bits is a bitfield that describes the move,
@@ -82,6 +144,37 @@ typedef struct {
 	int score;
 } gen_t;
 
+/* the state of the move picker, which hands out the moves of one
+   ply in stages; see next_move() in search.c */
+typedef struct {
+	int stage;
+	BOOL quiet;  /* FALSE if only captures and promotions are wanted */
+	move hash_move;
+	move killer[2];
+	move counter;  /* the counter move to the last move, or 0 */
+	int (*cont)[64];  /* the continuation history for the last move, or NULL */
+	int cur;  /* the next move in gen_dat to look at */
+	int quiet_start;  /* where the quiet moves start in gen_dat */
+	int bad_end;  /* the bad captures are from first_move[ply] to here */
+} picker_t;
+
+/* one line of the search's result: a PV and its score. In multi-PV
+   mode, the search finds one for each of the best few moves; see
+   iterate() in search.c */
+typedef struct {
+	move pv[MAX_PLY];
+	int length;
+	int score;
+} pv_line_t;
+
+/* the magic bitboard information for one square; see bitboard.c */
+typedef struct {
+	U64 mask;  /* the squares that can block the slider */
+	U64 magic;
+	U64 *attacks;  /* the attacks for each index */
+	int shift;
+} magic_t;
+
 /* an element of the history stack, with the information
    necessary to take a move back. */
 typedef struct {
@@ -90,5 +183,236 @@ typedef struct {
 	int castle;
 	int ep;
 	int fifty;
-	int hash;
+	U64 hash;
+	U64 pawn_hash;
 } hist_t;
+
+/* an entry of the pawn hash table, which holds everything eval()
+   works out from the pawns alone; see eval_pawns() in eval.c */
+typedef struct {
+	U64 key;  /* the pawn_hash of the pawns */
+	int pawn_rank[2][10];
+	int score[2];
+} pawn_entry_t;
+
+/* the types of score that can be stored in the transposition
+   table. HASH_EXACT means the score is exact, HASH_ALPHA means
+   the search failed low so the real score is at most the stored
+   score, and HASH_BETA means the search failed high so the real
+   score is at least the stored score. */
+#define HASH_EXACT		0
+#define HASH_ALPHA		1
+#define HASH_BETA		2
+
+/* the number of entries in a transposition table bucket */
+#define TT_BUCKET		4
+
+/* an entry in the transposition table. data holds the best move that
+   the search found (or 0 if it didn't find one), the score, the depth,
+   the type of score, and the number of the search that stored the
+   entry (so old entries can be replaced first); see store_tt() in
+   hash.c. key is the position's hash key XORed with data. That way
+   we can tell two positions that map to the same bucket apart, and
+   if two threads write the same entry at the same time, the mix of
+   their keys and data won't match any position, so no locks are
+   needed. */
+typedef struct {
+	U64 key;
+	U64 data;
+} tt_entry_t;
+
+/* a transposition table; see hash.c. entry is an array of mask + 1
+   buckets, each of which holds TT_BUCKET entries. age is incremented
+   every time think() is called, and mb is the size of the table in
+   megabytes. */
+typedef struct {
+	tt_entry_t *entry;
+	U64 mask;
+	int age;
+	int mb;
+} tt_t;
+
+
+/* An engine is everything that changes while TSCP plays a game: the
+   board, the game history, the move stacks, the search settings and
+   statistics, and so on. Almost every function takes a pointer to the
+   engine it works on (always called e), so a program can run as many
+   engines (and games) as it likes at the same time. The things that
+   never change once they're set up, like the hash keys and the attack
+   tables, are global variables in data.c. */
+typedef struct engine {
+
+	/* the board representation */
+	int color[64];  /* LIGHT, DARK, or EMPTY */
+	int piece[64];  /* PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING, or EMPTY */
+
+	/* the same information as bitboards (see bitboard.c). bb_piece[c][p]
+	   has a bit set for each square with a piece of color c and type p,
+	   bb_color[c] for each square with a piece of color c, and bb_all for
+	   each square with any piece on it. They're kept up to date by
+	   makemove() and takeback(); if you change color and piece directly,
+	   call set_bitboards(). */
+	U64 bb_piece[2][6];
+	U64 bb_color[2];
+	U64 bb_all;
+
+	int side;  /* the side to move */
+	int xside;  /* the side not to move */
+	int castle;  /* a bitfield with the castle permissions. if 1 is set,
+	                white can still castle kingside. 2 is white queenside.
+	                4 is black kingside. 8 is black queenside. */
+	int ep;  /* the en passant square. if white moves e2e4, the en passant
+	            square is set to e3, because that's where a pawn would move
+	            in an en passant capture */
+	int fifty;  /* the number of moves since a capture or pawn move, used
+	               to handle the fifty-move-draw rule */
+	U64 hash;  /* a (more or less) unique number that corresponds to the
+	              position */
+	U64 pawn_hash;  /* the same, but only for the pawns */
+	int ply;  /* the number of half-moves (ply) since the
+	             root of the search tree */
+	int hply;  /* h for history; the number of ply since the beginning
+	              of the game */
+
+	/* gen_dat is some memory for move lists that are created by the move
+	   generators. The move list for ply n starts at first_move[n] and ends
+	   at first_move[n + 1]. */
+	gen_t gen_dat[GEN_STACK];
+	int first_move[MAX_PLY];
+
+	/* the history heuristic array (used for move ordering) */
+	int history[64][64];
+
+	/* the killer moves: for each ply, the last two quiet moves that
+	   caused a beta cutoff there */
+	move killer[MAX_PLY][2];
+
+#ifdef USE_COUNTER
+	/* the counter moves: counter[c][p][sq] is the last quiet move that
+	   caused a beta cutoff right after a move of color c's piece p to
+	   square sq */
+	move counter[2][6][64];
+
+	/* the continuation history: cont_hist[p1][sq1][p2][sq2] is like the
+	   history heuristic's history[][], but for moving piece p2 to
+	   square sq2 right after the opponent moved piece p1 to sq1 */
+	int cont_hist[6][64][6][64];
+#endif
+
+	/* we need an array of hist_t's so we can take back the
+	   moves we make */
+	hist_t hist_dat[HIST_STACK];
+
+	/* TRUE if the game didn't start from the initial position but from
+	   a position set up with set_fen(), in which case the opening book
+	   doesn't apply */
+	BOOL fen_start;
+
+	/* the state of the engine's own random number generator, which
+	   book_move() uses to pick among the book moves */
+	U64 book_rand;
+
+	/* the engine will search for max_time milliseconds or until it finishes
+	   searching max_depth ply, or until it's searched max_nodes nodes (if
+	   max_nodes isn't 0). when it's playing with a clock, soft_time is
+	   the time it would like to use, and max_time is the most it can
+	   use (see set_clock()); otherwise soft_time is 0. */
+	int max_time;
+	int soft_time;
+	int max_depth;
+	int max_nodes;
+
+	/* which parts of the selective search are on (SEL_ flags) */
+	int selective;
+
+	/* the time when the engine starts searching, and when it should stop,
+	   in nanoseconds (see get_ns()) */
+	U64 start_time;
+	U64 stop_time;
+
+	/* the search calls checkup() when nodes reaches next_check.
+	   check_time and check_nodes are the time and the node count of the
+	   last checkup(), which it uses to find out how many nodes it takes
+	   to make POLL_NS nanoseconds go by. */
+	int next_check;
+	U64 check_time;
+	int check_nodes;
+
+	int nodes;  /* the number of nodes we've searched */
+	int depth;  /* the depth of the last iteration the search finished */
+	int score;  /* and its score */
+
+	/* a "triangular" PV array; for a good explanation of why a triangular
+	   array is needed, see "How Computers Play Chess" by Levy and Newborn. */
+	move pv[MAX_PLY][MAX_PLY];
+	int pv_length[MAX_PLY];
+	BOOL follow_pv;
+
+	/* multi-PV mode: iterate() finds the best multipv moves instead of
+	   just the best one, each with its own line in line[], best first.
+	   lines is the number of lines of the last finished iteration. While
+	   it searches for line pv_index, the moves of the lines before it
+	   are excluded at the root. */
+	int multipv;
+	pv_line_t line[MAX_MULTIPV];
+	int lines;
+	int pv_index;
+
+	/* pawn_rank[x][y] is the rank of the least advanced pawn of color x on
+	   file y - 1; see eval() in eval.c. piece_mat and pawn_mat are the value
+	   of each side's pieces and pawns, and pcsq is the sum of the
+	   piece/square values of each side's pawns, knights, and bishops.
+	   add_piece() and remove_piece() keep those three up to date. */
+	int pawn_rank[2][10];
+	int piece_mat[2];
+	int pawn_mat[2];
+	int pcsq[2];
+
+	/* the pawn hash table. every engine has its own, so the threads
+	   don't have to share it. */
+	pawn_entry_t pawn_table[PAWN_HASH_SIZE];
+
+	/* stop_search tells the search to stop. search() and quiesce()
+	   check it after every move and return right away when it's set,
+	   so it can be set at any time, e.g., by another thread. It's
+	   only ever set to TRUE while a search is running (think() clears
+	   it before starting), so a plain volatile int is enough. */
+	volatile BOOL stop_search;
+
+	/* pondering is TRUE while the engine searches on the opponent's
+	   time, in the position after the move it expects the opponent to
+	   make (ponder_move, which is 0 if the GUI made it, as in UCI).
+	   The time limits don't apply then. When the opponent does make
+	   that move, the input thread sets ponder_hit, and the search goes
+	   on as a normal search, with the clock starting then; see think()
+	   and checkup(). */
+	volatile BOOL pondering;
+	volatile BOOL ponder_hit;
+	move ponder_move;
+
+	/* the clock for a ponder hit in xboard mode: our time left in
+	   milliseconds, which the input thread sets when xboard sends it
+	   during pondering (-1 until then), and the other arguments for
+	   set_clock(); see xboard_ponder() in main.c */
+	volatile int ponder_time;
+	int ponder_inc;
+	int ponder_movestogo;
+
+	/* TRUE for a search without limits, which only stops when it's
+	   told to (UCI's "go infinite") */
+	BOOL infinite;
+
+	/* the transposition table. helper engines share their master's. */
+	tt_t *tt;
+
+	/* think() searches with threads threads: this engine and
+	   threads - 1 helper engines, which are created when they're
+	   first needed. A helper's master is the engine it's helping
+	   (it's NULL for an engine that isn't a helper), and id is the
+	   helper's number (0 for a master). Helpers stop when their
+	   master's stop_search is set. */
+	int threads;
+	struct engine *helper[MAX_THREADS];
+	struct engine *master;
+	int id;
+} engine_t;
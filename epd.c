@@ -0,0 +1,156 @@
+/*
+ *	EPD.C
+ *	Tom Kerrigan's Simple Chess Program (TSCP)
+ *
+ *	Copyright 2016 Tom Kerrigan
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include "defs.h"
+#include "data.h"
+#include "protos.h"
+
+
+/* EPD (Extended Position Description) is a format for test suites.
+   Each line is a position in the first four fields of FEN, followed by
+   "operations" like these:
+
+   2rr3k/pp3pp1/1nnqbN1p/3pN3/2pP4/2P3Q1/PPB4P/R4RK1 w - - bm Qg6; id "WAC.001";
+
+   bm gives the best move (or moves) in SAN, am gives moves to avoid,
+   and id names the position. epd_suite() searches every position of
+   a suite and counts how many it solves. */
+
+
+/* epd_op() finds operation op in the operations of an EPD line and
+   copies its operands to s (without quotes). It returns FALSE if the
+   line doesn't have the operation. */
+
+BOOL epd_op(char *line, char *op, char *s, int size)
+{
+	char *p;
+	int n = 0;
+	int fields = 0;
+	int len = (int)strlen(op);
+
+	/* skip the four position fields */
+	for (p = line; *p && fields < 4; ++fields) {
+		while (*p == ' ' || *p == '\t')
+			++p;
+		while (*p && *p != ' ' && *p != '\t')
+			++p;
+	}
+
+	/* look at the opcode of each operation */
+	while (*p) {
+		while (*p == ' ' || *p == '\t')
+			++p;
+		if (!strncmp(p, op, len) && (p[len] == ' ' || p[len] == '\t')) {
+			for (p += len; *p == ' ' || *p == '\t'; ++p)
+				;
+			for (; *p && *p != ';' && *p != '\n' && *p != '\r' && n < size - 1; ++p)
+				if (*p != '"')
+					s[n++] = *p;
+			s[n] = '\0';
+			return TRUE;
+		}
+
+		/* skip to the next operation, but not in the middle of a
+		   quoted string */
+		for (; *p && *p != ';'; ++p)
+			if (*p == '"')
+				for (++p; *p && *p != '"'; ++p)
+					;
+		if (*p == ';')
+			++p;
+	}
+	return FALSE;
+}
+
+
+/* san_in() returns TRUE if the SAN move san is one of the moves in
+   list, which is a list of SAN moves separated by spaces. */
+
+BOOL san_in(char *san, char *list)
+{
+	char a[16], b[16];
+
+	san_strip(san, a);
+	for (;;) {
+		while (*list == ' ')
+			++list;
+		if (!*list)
+			return FALSE;
+		san_strip(list, b);
+		if (!strcmp(a, b))
+			return TRUE;
+		while (*list && *list != ' ')
+			++list;
+	}
+}
+
+
+/* epd_suite() runs the test suite in the EPD file name. Each position
+   is searched with the engine's limits (see the st, sd, and sn
+   commands) and a cleared hash table. A position is solved if the
+   engine plays one of the bm moves, or (if there aren't any) none of
+   the am moves. */
+
+void epd_suite(engine_t *e, char *name)
+{
+	FILE *f;
+	char line[1024];
+	char id[64], bm[128], am[128];
+	char san[16];
+	int positions = 0, solved = 0;
+	int t, total_time = 0;
+	U64 total_nodes = 0;
+	BOOL ok;
+
+	f = fopen(name, "r");
+	if (!f) {
+		printf("Can't open %s.\n", name);
+		return;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#' || !set_fen(e, line))
+			continue;
+		++positions;
+		if (!epd_op(line, "id", id, sizeof(id)))
+			sprintf(id, "%d", positions);
+		if (!epd_op(line, "bm", bm, sizeof(bm)))
+			bm[0] = '\0';
+		if (!epd_op(line, "am", am, sizeof(am)))
+			am[0] = '\0';
+
+		clear_tt(e->tt);
+		think(e, 0);
+		t = search_time(e);
+		strcpy(san, e->pv[0][0].u ? move_san(e, e->pv[0][0].b) : "none");
+		if (bm[0])
+			ok = san_in(san, bm);
+		else
+			ok = am[0] && !san_in(san, am);
+		if (ok)
+			++solved;
+		total_nodes += e->nodes;
+		total_time += t;
+		printf("%-16s %-7s %-7s %-16s %10d nodes %7d ms\n",
+				id, ok ? "solved" : "failed", san,
+				bm[0] ? bm : am, e->nodes, t);
+		fflush(stdout);
+	}
+	fclose(f);
+
+	printf("\n");
+	printf("Solved: %d of %d\n", solved, positions);
+	printf("Nodes: %llu\n", total_nodes);
+	printf("Time: %d ms\n", total_time);
+	if (total_time)
+		printf("Solved per second: %.3f\n", solved * 1000.0 / total_time);
+
+	init_board(e);
+	gen(e);
+}
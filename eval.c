@@ -21,11 +21,6 @@
 #define ROOK_ON_SEVENTH_BONUS		20
 
 
-/* the values of the pieces */
-int piece_value[6] = {
-	100, 300, 300, 500, 900, 0
-};
-
 /* The "pcsq" arrays are piece/square tables. They're values
    added to the material value of the piece based on the
    location of the piece. */
@@ -100,124 +95,148 @@ int flip[64] = {
 	  0,   1,   2,   3,   4,   5,   6,   7
 };
 
-/* pawn_rank[x][y] is the rank of the least advanced pawn of color x on file
-   y - 1. There are "buffer files" on the left and right to avoid special-case
-   logic later. If there's no pawn on a rank, we pretend the pawn is
-   impossibly far advanced (0 for LIGHT and 7 for DARK). This makes it easy to
-   test for pawns on a rank and it simplifies some pawn evaluation code. */
-int pawn_rank[2][10];
-
-int piece_mat[2];  /* the value of a side's pieces */
-int pawn_mat[2];  /* the value of a side's pawns */
+/* init_eval() fills in piece_pcsq (see data.c) from the piece/square
+   tables above. The tables are from LIGHT's point of view, so DARK's
+   values are looked up on the flipped square. Rooks and kings aren't
+   in piece_pcsq, since eval() scores them separately. */
 
-int eval()
+void init_eval()
 {
 	int i;
-	int f;  /* file */
-	int score[2];  /* each side's score */
 
-	/* this is the first pass: set up pawn_rank, piece_mat, and pawn_mat. */
-	for (i = 0; i < 10; ++i) {
-		pawn_rank[LIGHT][i] = 0;
-		pawn_rank[DARK][i] = 7;
-	}
-	piece_mat[LIGHT] = 0;
-	piece_mat[DARK] = 0;
-	pawn_mat[LIGHT] = 0;
-	pawn_mat[DARK] = 0;
+	memset(piece_pcsq, 0, sizeof(piece_pcsq));
 	for (i = 0; i < 64; ++i) {
-		if (color[i] == EMPTY)
-			continue;
-		if (piece[i] == PAWN) {
-			pawn_mat[color[i]] += piece_value[PAWN];
-			f = COL(i) + 1;  /* add 1 because of the extra file in the array */
-			if (color[i] == LIGHT) {
-				if (pawn_rank[LIGHT][f] < ROW(i))
-					pawn_rank[LIGHT][f] = ROW(i);
-			}
-			else {
-				if (pawn_rank[DARK][f] > ROW(i))
-					pawn_rank[DARK][f] = ROW(i);
-			}
-		}
-		else
-			piece_mat[color[i]] += piece_value[piece[i]];
+		piece_pcsq[LIGHT][PAWN][i] = pawn_pcsq[i];
+		piece_pcsq[LIGHT][KNIGHT][i] = knight_pcsq[i];
+		piece_pcsq[LIGHT][BISHOP][i] = bishop_pcsq[i];
+		piece_pcsq[DARK][PAWN][i] = pawn_pcsq[flip[i]];
+		piece_pcsq[DARK][KNIGHT][i] = knight_pcsq[flip[i]];
+		piece_pcsq[DARK][BISHOP][i] = bishop_pcsq[flip[i]];
 	}
+}
 
-	/* this is the second pass: evaluate each piece */
-	score[LIGHT] = piece_mat[LIGHT] + pawn_mat[LIGHT];
-	score[DARK] = piece_mat[DARK] + pawn_mat[DARK];
-	for (i = 0; i < 64; ++i) {
-		if (color[i] == EMPTY)
-			continue;
-		if (color[i] == LIGHT) {
-			switch (piece[i]) {
-				case PAWN:
-					score[LIGHT] += eval_light_pawn(i);
-					break;
-				case KNIGHT:
-					score[LIGHT] += knight_pcsq[i];
-					break;
-				case BISHOP:
-					score[LIGHT] += bishop_pcsq[i];
-					break;
-				case ROOK:
-					if (pawn_rank[LIGHT][COL(i) + 1] == 0) {
-						if (pawn_rank[DARK][COL(i) + 1] == 7)
-							score[LIGHT] += ROOK_OPEN_FILE_BONUS;
-						else
-							score[LIGHT] += ROOK_SEMI_OPEN_FILE_BONUS;
-					}
-					if (ROW(i) == 1)
-						score[LIGHT] += ROOK_ON_SEVENTH_BONUS;
-					break;
-				case KING:
-					if (piece_mat[DARK] <= 1200)
-						score[LIGHT] += king_endgame_pcsq[i];
-					else
-						score[LIGHT] += eval_light_king(i);
-					break;
-			}
+/* eval() returns the score of the position from the point of view of
+   the side to move. Along the way (in eval_pawns()) it fills in the
+   engine's pawn_rank: pawn_rank[x][y] is the rank of the least advanced
+   pawn of color x on file y - 1. There are "buffer files" on the left
+   and right to avoid special-case logic later. If there's no pawn on a
+   rank, we pretend the pawn is impossibly far advanced (0 for LIGHT and
+   7 for DARK). This makes it easy to test for pawns on a rank and it
+   simplifies some pawn evaluation code. */
+
+int eval(engine_t *e)
+{
+	int i;
+	int score[2];  /* each side's score */
+	U64 b;
+
+	/* the material and the piece/square values of the pawns, knights,
+	   and bishops are kept up to date by makemove() and takeback(), so
+	   we just have to add the things that depend on more than one
+	   piece: the pawn structure (eval_pawns() also sets up pawn_rank),
+	   the rooks, and the kings. */
+	eval_pawns(e, score);
+	score[LIGHT] += e->piece_mat[LIGHT] + e->pawn_mat[LIGHT] + e->pcsq[LIGHT];
+	score[DARK] += e->piece_mat[DARK] + e->pawn_mat[DARK] + e->pcsq[DARK];
+
+	for (b = e->bb_piece[LIGHT][ROOK]; b; b &= b - 1) {
+		i = LSB(b);
+		if (e->pawn_rank[LIGHT][COL(i) + 1] == 0) {
+			if (e->pawn_rank[DARK][COL(i) + 1] == 7)
+				score[LIGHT] += ROOK_OPEN_FILE_BONUS;
+			else
+				score[LIGHT] += ROOK_SEMI_OPEN_FILE_BONUS;
 		}
-		else {
-			switch (piece[i]) {
-				case PAWN:
-					score[DARK] += eval_dark_pawn(i);
-					break;
-				case KNIGHT:
-					score[DARK] += knight_pcsq[flip[i]];
-					break;
-				case BISHOP:
-					score[DARK] += bishop_pcsq[flip[i]];
-					break;
-				case ROOK:
-					if (pawn_rank[DARK][COL(i) + 1] == 7) {
-						if (pawn_rank[LIGHT][COL(i) + 1] == 0)
-							score[DARK] += ROOK_OPEN_FILE_BONUS;
-						else
-							score[DARK] += ROOK_SEMI_OPEN_FILE_BONUS;
-					}
-					if (ROW(i) == 6)
-						score[DARK] += ROOK_ON_SEVENTH_BONUS;
-					break;
-				case KING:
-					if (piece_mat[LIGHT] <= 1200)
-						score[DARK] += king_endgame_pcsq[flip[i]];
-					else
-						score[DARK] += eval_dark_king(i);
-					break;
-			}
+		if (ROW(i) == 1)
+			score[LIGHT] += ROOK_ON_SEVENTH_BONUS;
+	}
+	for (b = e->bb_piece[DARK][ROOK]; b; b &= b - 1) {
+		i = LSB(b);
+		if (e->pawn_rank[DARK][COL(i) + 1] == 7) {
+			if (e->pawn_rank[LIGHT][COL(i) + 1] == 0)
+				score[DARK] += ROOK_OPEN_FILE_BONUS;
+			else
+				score[DARK] += ROOK_SEMI_OPEN_FILE_BONUS;
 		}
+		if (ROW(i) == 6)
+			score[DARK] += ROOK_ON_SEVENTH_BONUS;
+	}
+
+	if (e->bb_piece[LIGHT][KING]) {
+		i = LSB(e->bb_piece[LIGHT][KING]);
+		if (e->piece_mat[DARK] <= 1200)
+			score[LIGHT] += king_endgame_pcsq[i];
+		else
+			score[LIGHT] += eval_light_king(e, i);
+	}
+	if (e->bb_piece[DARK][KING]) {
+		i = LSB(e->bb_piece[DARK][KING]);
+		if (e->piece_mat[LIGHT] <= 1200)
+			score[DARK] += king_endgame_pcsq[flip[i]];
+		else
+			score[DARK] += eval_dark_king(e, i);
 	}
 
 	/* the score[] array is set, now return the score relative
 	   to the side to move */
-	if (side == LIGHT)
+	if (e->side == LIGHT)
 		return score[LIGHT] - score[DARK];
 	return score[DARK] - score[LIGHT];
 }
 
-int eval_light_pawn(int sq)
+/* eval_pawns() sets up pawn_rank and puts the value of each side's
+   pawn structure in score[].
+   All of that depends only on where the pawns are, and the pawns don't
+   move very often, so the results are saved in the pawn hash table
+   under pawn_hash. (A position without pawns has a pawn_hash of 0,
+   which is also the key of an empty entry, so we don't look those up.
+   They're cheap anyway.) */
+
+void eval_pawns(engine_t *e, int score[2])
+{
+	pawn_entry_t *p;
+	U64 b;
+	int i;
+	int f;  /* file */
+
+	p = &e->pawn_table[e->pawn_hash & (PAWN_HASH_SIZE - 1)];
+	if (p->key == e->pawn_hash && e->pawn_hash) {
+		memcpy(e->pawn_rank, p->pawn_rank, sizeof(e->pawn_rank));
+		score[LIGHT] = p->score[LIGHT];
+		score[DARK] = p->score[DARK];
+		return;
+	}
+
+	for (i = 0; i < 10; ++i) {
+		e->pawn_rank[LIGHT][i] = 0;
+		e->pawn_rank[DARK][i] = 7;
+	}
+	for (b = e->bb_piece[LIGHT][PAWN]; b; b &= b - 1) {
+		i = LSB(b);
+		f = COL(i) + 1;  /* add 1 because of the extra file in the array */
+		if (e->pawn_rank[LIGHT][f] < ROW(i))
+			e->pawn_rank[LIGHT][f] = ROW(i);
+	}
+	for (b = e->bb_piece[DARK][PAWN]; b; b &= b - 1) {
+		i = LSB(b);
+		f = COL(i) + 1;
+		if (e->pawn_rank[DARK][f] > ROW(i))
+			e->pawn_rank[DARK][f] = ROW(i);
+	}
+	score[LIGHT] = 0;
+	score[DARK] = 0;
+	for (b = e->bb_piece[LIGHT][PAWN]; b; b &= b - 1)
+		score[LIGHT] += eval_light_pawn(e, LSB(b));
+	for (b = e->bb_piece[DARK][PAWN]; b; b &= b - 1)
+		score[DARK] += eval_dark_pawn(e, LSB(b));
+
+	p->key = e->pawn_hash;
+	memcpy(p->pawn_rank, e->pawn_rank, sizeof(e->pawn_rank));
+	p->score[LIGHT] = score[LIGHT];
+	p->score[DARK] = score[DARK];
+}
+
+int eval_light_pawn(engine_t *e, int sq)
 {
 	int r;  /* the value to return */
 	int f;  /* the pawn's file */
@@ -225,33 +244,31 @@ int eval_light_pawn(int sq)
 	r = 0;
 	f = COL(sq) + 1;
 
-	r += pawn_pcsq[sq];
-
 	/* if there's a pawn behind this one, it's doubled */
-	if (pawn_rank[LIGHT][f] > ROW(sq))
+	if (e->pawn_rank[LIGHT][f] > ROW(sq))
 		r -= DOUBLED_PAWN_PENALTY;
 
 	/* if there aren't any friendly pawns on either side of
 	   this one, it's isolated */
-	if ((pawn_rank[LIGHT][f - 1] == 0) &&
-			(pawn_rank[LIGHT][f + 1] == 0))
+	if ((e->pawn_rank[LIGHT][f - 1] == 0) &&
+			(e->pawn_rank[LIGHT][f + 1] == 0))
 		r -= ISOLATED_PAWN_PENALTY;
 
 	/* if it's not isolated, it might be backwards */
-	else if ((pawn_rank[LIGHT][f - 1] < ROW(sq)) &&
-			(pawn_rank[LIGHT][f + 1] < ROW(sq)))
+	else if ((e->pawn_rank[LIGHT][f - 1] < ROW(sq)) &&
+			(e->pawn_rank[LIGHT][f + 1] < ROW(sq)))
 		r -= BACKWARDS_PAWN_PENALTY;
 
 	/* add a bonus if the pawn is passed */
-	if ((pawn_rank[DARK][f - 1] >= ROW(sq)) &&
-			(pawn_rank[DARK][f] >= ROW(sq)) &&
-			(pawn_rank[DARK][f + 1] >= ROW(sq)))
+	if ((e->pawn_rank[DARK][f - 1] >= ROW(sq)) &&
+			(e->pawn_rank[DARK][f] >= ROW(sq)) &&
+			(e->pawn_rank[DARK][f + 1] >= ROW(sq)))
 		r += (7 - ROW(sq)) * PASSED_PAWN_BONUS;
 
 	return r;
 }
 
-int eval_dark_pawn(int sq)
+int eval_dark_pawn(engine_t *e, int sq)
 {
 	int r;  /* the value to return */
 	int f;  /* the pawn's file */
@@ -259,33 +276,31 @@ int eval_dark_pawn(int sq)
 	r = 0;
 	f = COL(sq) + 1;
 
-	r += pawn_pcsq[flip[sq]];
-
 	/* if there's a pawn behind this one, it's doubled */
-	if (pawn_rank[DARK][f] < ROW(sq))
+	if (e->pawn_rank[DARK][f] < ROW(sq))
 		r -= DOUBLED_PAWN_PENALTY;
 
 	/* if there aren't any friendly pawns on either side of
 	   this one, it's isolated */
-	if ((pawn_rank[DARK][f - 1] == 7) &&
-			(pawn_rank[DARK][f + 1] == 7))
+	if ((e->pawn_rank[DARK][f - 1] == 7) &&
+			(e->pawn_rank[DARK][f + 1] == 7))
 		r -= ISOLATED_PAWN_PENALTY;
 
 	/* if it's not isolated, it might be backwards */
-	else if ((pawn_rank[DARK][f - 1] > ROW(sq)) &&
-			(pawn_rank[DARK][f + 1] > ROW(sq)))
+	else if ((e->pawn_rank[DARK][f - 1] > ROW(sq)) &&
+			(e->pawn_rank[DARK][f + 1] > ROW(sq)))
 		r -= BACKWARDS_PAWN_PENALTY;
 
 	/* add a bonus if the pawn is passed */
-	if ((pawn_rank[LIGHT][f - 1] <= ROW(sq)) &&
-			(pawn_rank[LIGHT][f] <= ROW(sq)) &&
-			(pawn_rank[LIGHT][f + 1] <= ROW(sq)))
+	if ((e->pawn_rank[LIGHT][f - 1] <= ROW(sq)) &&
+			(e->pawn_rank[LIGHT][f] <= ROW(sq)) &&
+			(e->pawn_rank[LIGHT][f + 1] <= ROW(sq)))
 		r += ROW(sq) * PASSED_PAWN_BONUS;
 
 	return r;
 }
 
-int eval_light_king(int sq)
+int eval_light_king(engine_t *e, int sq)
 {
 	int r;  /* the value to return */
 	int i;
@@ -295,30 +310,30 @@ int eval_light_king(int sq)
 	/* if the king is castled, use a special function to evaluate the
 	   pawns on the appropriate side */
 	if (COL(sq) < 3) {
-		r += eval_lkp(1);
-		r += eval_lkp(2);
-		r += eval_lkp(3) / 2;  /* problems with pawns on the c & f files
+		r += eval_lkp(e, 1);
+		r += eval_lkp(e, 2);
+		r += eval_lkp(e, 3) / 2;  /* problems with pawns on the c & f files
 								  are not as severe */
 	}
 	else if (COL(sq) > 4) {
-		r += eval_lkp(8);
-		r += eval_lkp(7);
-		r += eval_lkp(6) / 2;
+		r += eval_lkp(e, 8);
+		r += eval_lkp(e, 7);
+		r += eval_lkp(e, 6) / 2;
 	}
 
 	/* otherwise, just assess a penalty if there are open files near
 	   the king */
 	else {
 		for (i = COL(sq); i <= COL(sq) + 2; ++i)
-			if ((pawn_rank[LIGHT][i] == 0) &&
-					(pawn_rank[DARK][i] == 7))
+			if ((e->pawn_rank[LIGHT][i] == 0) &&
+					(e->pawn_rank[DARK][i] == 7))
 				r -= 10;
 	}
 
 	/* scale the king safety value according to the opponent's material;
 	   the premise is that your king safety can only be bad if the
 	   opponent has enough pieces to attack you */
-	r *= piece_mat[DARK];
+	r *= e->piece_mat[DARK];
 	r /= 3100;
 
 	return r;
@@ -326,72 +341,72 @@ int eval_light_king(int sq)
 
 /* eval_lkp(f) evaluates the Light King Pawn on file f */
 
-int eval_lkp(int f)
+int eval_lkp(engine_t *e, int f)
 {
 	int r = 0;
 
-	if (pawn_rank[LIGHT][f] == 6);  /* pawn hasn't moved */
-	else if (pawn_rank[LIGHT][f] == 5)
+	if (e->pawn_rank[LIGHT][f] == 6);  /* pawn hasn't moved */
+	else if (e->pawn_rank[LIGHT][f] == 5)
 		r -= 10;  /* pawn moved one square */
-	else if (pawn_rank[LIGHT][f] != 0)
+	else if (e->pawn_rank[LIGHT][f] != 0)
 		r -= 20;  /* pawn moved more than one square */
 	else
 		r -= 25;  /* no pawn on this file */
 
-	if (pawn_rank[DARK][f] == 7)
+	if (e->pawn_rank[DARK][f] == 7)
 		r -= 15;  /* no enemy pawn */
-	else if (pawn_rank[DARK][f] == 5)
+	else if (e->pawn_rank[DARK][f] == 5)
 		r -= 10;  /* enemy pawn on the 3rd rank */
-	else if (pawn_rank[DARK][f] == 4)
+	else if (e->pawn_rank[DARK][f] == 4)
 		r -= 5;   /* enemy pawn on the 4th rank */
 
 	return r;
 }
 
-int eval_dark_king(int sq)
+int eval_dark_king(engine_t *e, int sq)
 {
 	int r;
 	int i;
 
 	r = king_pcsq[flip[sq]];
 	if (COL(sq) < 3) {
-		r += eval_dkp(1);
-		r += eval_dkp(2);
-		r += eval_dkp(3) / 2;
+		r += eval_dkp(e, 1);
+		r += eval_dkp(e, 2);
+		r += eval_dkp(e, 3) / 2;
 	}
 	else if (COL(sq) > 4) {
-		r += eval_dkp(8);
-		r += eval_dkp(7);
-		r += eval_dkp(6) / 2;
+		r += eval_dkp(e, 8);
+		r += eval_dkp(e, 7);
+		r += eval_dkp(e, 6) / 2;
 	}
 	else {
 		for (i = COL(sq); i <= COL(sq) + 2; ++i)
-			if ((pawn_rank[LIGHT][i] == 0) &&
-					(pawn_rank[DARK][i] == 7))
+			if ((e->pawn_rank[LIGHT][i] == 0) &&
+					(e->pawn_rank[DARK][i] == 7))
 				r -= 10;
 	}
-	r *= piece_mat[LIGHT];
+	r *= e->piece_mat[LIGHT];
 	r /= 3100;
 	return r;
 }
 
-int eval_dkp(int f)
+int eval_dkp(engine_t *e, int f)
 {
 	int r = 0;
 
-	if (pawn_rank[DARK][f] == 1);
-	else if (pawn_rank[DARK][f] == 2)
+	if (e->pawn_rank[DARK][f] == 1);
+	else if (e->pawn_rank[DARK][f] == 2)
 		r -= 10;
-	else if (pawn_rank[DARK][f] != 7)
+	else if (e->pawn_rank[DARK][f] != 7)
 		r -= 20;
 	else
 		r -= 25;
 
-	if (pawn_rank[LIGHT][f] == 0)
+	if (e->pawn_rank[LIGHT][f] == 0)
 		r -= 15;
-	else if (pawn_rank[LIGHT][f] == 2)
+	else if (e->pawn_rank[LIGHT][f] == 2)
 		r -= 10;
-	else if (pawn_rank[LIGHT][f] == 3)
+	else if (e->pawn_rank[LIGHT][f] == 3)
 		r -= 5;
 
 	return r;
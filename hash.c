@@ -0,0 +1,170 @@
+/*
+ *	HASH.C
+ *	Tom Kerrigan's Simple Chess Program (TSCP)
+ *
+ *	Copyright 2016 Tom Kerrigan
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "defs.h"
+#include "data.h"
+#include "protos.h"
+
+
+/* The transposition table remembers the results of searches so we
+   don't have to search the same position twice. That happens a lot:
+   the same position can be reached by different move orders (a
+   "transposition"), and every iteration of think() searches all of
+   the positions from the previous iteration again. Each entry is
+   found using the position's hash key (see set_hash() in board.c).
+   An engine's helper threads share its table. */
+
+
+/* alloc_tt() gives table t (at most) mb megabytes of entries. The
+   number of buckets is a power of two so we can find a position's
+   bucket with a mask instead of a division. */
+
+void alloc_tt(tt_t *t, int mb)
+{
+	U64 buckets;
+
+	free(t->entry);
+	t->entry = NULL;
+	if (mb < 1)
+		mb = 1;
+	buckets = 1;
+	while ((double)buckets * 2 * TT_BUCKET * sizeof(tt_entry_t) <= mb * 1048576.0)
+		buckets *= 2;
+	while (!t->entry && buckets) {
+		t->entry = (tt_entry_t *)malloc((size_t)buckets * TT_BUCKET * sizeof(tt_entry_t));
+		if (!t->entry)
+			buckets /= 2;
+	}
+	if (!t->entry) {
+		printf("Can't allocate the hash table.\n");
+		exit(1);
+	}
+	t->mask = buckets - 1;
+	t->mb = mb;
+	clear_tt(t);
+}
+
+
+/* clear_tt() erases everything in table t. It's called when we start
+   a new game. */
+
+void clear_tt(tt_t *t)
+{
+	memset(t->entry, 0, (size_t)(t->mask + 1) * TT_BUCKET * sizeof(tt_entry_t));
+	t->age = 0;
+}
+
+
+/* The fields of an entry's data are packed like this:
+   bits 0-31   the best move (move.u)
+   bits 32-47  the score
+   bits 48-55  the depth
+   bits 56-57  the type of score (HASH_EXACT, HASH_ALPHA, or HASH_BETA)
+   bits 58-63  the age (the low 6 bits of the table's age) */
+
+#define TT_MOVE(d)		((int)(unsigned int)(d))
+#define TT_SCORE(d)		((int)(short)((d) >> 32))
+#define TT_DEPTH(d)		((int)(((d) >> 48) & 255))
+#define TT_FLAGS(d)		((int)(((d) >> 56) & 3))
+#define TT_AGE(d)		((int)((d) >> 58))
+
+
+/* probe_tt() looks up the current position in the transposition
+   table. If it's there, *m is set to the best move that was stored
+   with it (otherwise it's set to 0). If the stored search was at
+   least depth ply deep and its score tells us what to do at this
+   node, *score is set and probe_tt() returns TRUE. */
+
+BOOL probe_tt(engine_t *e, int depth, int alpha, int beta, int *score, move *m)
+{
+	int i, s, flags;
+	tt_entry_t *t;
+	U64 d;
+
+	m->u = 0;
+	t = &e->tt->entry[(e->hash & e->tt->mask) * TT_BUCKET];
+	for (i = 0; i < TT_BUCKET; ++i, ++t) {
+		d = t->data;
+		if ((t->key ^ d) == e->hash) {
+			m->u = TT_MOVE(d);
+			if (TT_DEPTH(d) < depth)
+				return FALSE;
+
+			/* mate scores are stored relative to the position,
+			   not the root, so convert them back */
+			s = TT_SCORE(d);
+			if (s > 9000)
+				s -= e->ply;
+			else if (s < -9000)
+				s += e->ply;
+
+			flags = TT_FLAGS(d);
+			if (flags == HASH_EXACT ||
+					(flags == HASH_ALPHA && s <= alpha) ||
+					(flags == HASH_BETA && s >= beta)) {
+				*score = s;
+				return TRUE;
+			}
+			return FALSE;
+		}
+	}
+	return FALSE;
+}
+
+
+/* tt_worth() is how much we'd like to keep an entry: entries from
+   the current search are worth more than old ones, and deep searches
+   are worth more than shallow ones. */
+
+#define tt_worth(d)		(TT_DEPTH(d) + (TT_AGE(d) == (e->tt->age & 63) ? 256 : 0))
+
+
+/* store_tt() saves the result of a search in the transposition
+   table. If the position is already in its bucket, that entry is
+   overwritten. Otherwise we replace an entry from an earlier search
+   or, if there aren't any, the entry with the shallowest search. */
+
+void store_tt(engine_t *e, int depth, int score, int flags, move m)
+{
+	int i;
+	tt_entry_t *t;
+	tt_entry_t *r;  /* the entry to replace */
+	U64 d;
+
+	t = &e->tt->entry[(e->hash & e->tt->mask) * TT_BUCKET];
+	r = t;
+	for (i = 0; i < TT_BUCKET; ++i, ++t) {
+		d = t->data;
+		if ((t->key ^ d) == e->hash) {
+			r = t;
+
+			/* keep the old best move if we don't have a new one */
+			if (!m.u)
+				m.u = TT_MOVE(d);
+			break;
+		}
+		if (tt_worth(d) < tt_worth(r->data))
+			r = t;
+	}
+
+	if (score > 9000)
+		score += e->ply;
+	else if (score < -9000)
+		score -= e->ply;
+
+	d = (U64)(unsigned int)m.u |
+			((U64)(unsigned short)score << 32) |
+			((U64)depth << 48) |
+			((U64)flags << 56) |
+			((U64)(e->tt->age & 63) << 58);
+	r->key = e->hash ^ d;
+	r->data = d;
+}
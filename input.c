@@ -0,0 +1,287 @@
+/*
+ *	INPUT.C
+ *	Tom Kerrigan's Simple Chess Program (TSCP)
+ *
+ *	Copyright 2016 Tom Kerrigan
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "defs.h"
+#include "data.h"
+#include "protos.h"
+
+
+/* The input thread reads stdin one line at a time and puts the lines in
+   a queue, which main(), xboard(), and uci() read with get_line(). That
+   way the engine hears commands while it's thinking, too: the commands
+   that have to be handled during a search are handled right away by
+   the input thread:
+
+   stop, ?, quit  stop the search (by setting stop_search, so the search
+                  notices within a node or two). They're queued as
+                  well, so the main loop still sees them.
+   isready        is answered with readyok right away during a search.
+                  Between searches, it's queued like anything else, so
+                  the answer comes after the commands before it have
+                  been handled.
+   ponderhit      or the move the engine is pondering on (see
+                  ponder_move in defs.h) sets ponder_hit when the
+                  engine is pondering. It isn't queued, because the
+                  move has already been made.
+
+   Any other command stops pondering, except for time and otim, which
+   xboard sends right before the opponent's move.
+
+   think() calls input_search() when it starts and finishes, so the
+   input thread knows when the engine is searching. A stop that arrives
+   after a "go" but before think() gets going is still in the queue
+   then, so input_search() finds it and stops the search right away.
+
+   The end of the input doesn't stop a search, so that piping commands
+   like "bench" into the program works. */
+
+
+typedef struct line_node {
+	struct line_node *next;
+	char s[1];  /* the line (allocated with the node) */
+} line_t;
+
+
+engine_t *input_engine = NULL;  /* the engine the commands are for */
+BOOL input_searching = FALSE;  /* is input_engine searching? */
+line_t *input_head = NULL;  /* the queue */
+line_t *input_tail = NULL;
+BOOL input_eof = FALSE;  /* did stdin end? */
+BOOL input_stopped = FALSE;  /* did stop_input() get called? */
+void *input_mutex;  /* protects everything above */
+void *input_cond;  /* signaled when a line is queued */
+
+
+/* start_input() starts the input thread. Commands that are read during
+   a search are for engine e. The thread is detached: it's usually
+   stuck in fgets() when the program ends, so nobody could join it. */
+
+void start_input(engine_t *e)
+{
+	input_engine = e;
+	input_mutex = new_mutex();
+	input_cond = new_cond();
+	if (!input_mutex || !input_cond || !start_detached(input_thread, NULL)) {
+		printf("Can't start the input thread.\n");
+		exit(1);
+	}
+}
+
+
+/* stop_input() is called when the program exits. It frees the lines
+   nobody read, and the mutex and condition variable if the input thread
+   has ended. If it hasn't, the thread frees them when its fgets()
+   returns, since it's the last one to use them. */
+
+void stop_input()
+{
+	line_t *l;
+	BOOL ended;
+
+	lock_mutex(input_mutex);
+	while (input_head) {
+		l = input_head;
+		input_head = l->next;
+		free(l);
+	}
+	input_tail = NULL;
+	input_stopped = TRUE;
+	ended = input_eof;
+	unlock_mutex(input_mutex);
+	if (ended) {
+		free_mutex(input_mutex);
+		free_cond(input_cond);
+	}
+}
+
+
+/* input_thread() is the function the input thread runs */
+
+void input_thread(void *arg)
+{
+	char s[8192];
+	line_t *l;
+	BOOL eof;
+
+	(void)arg;
+	for (;;) {
+		eof = !fgets(s, sizeof(s), stdin);
+		lock_mutex(input_mutex);
+		if (input_stopped) {
+			unlock_mutex(input_mutex);
+			free_mutex(input_mutex);
+			free_cond(input_cond);
+			return;
+		}
+		if (eof) {
+			input_eof = TRUE;
+			signal_cond(input_cond);
+			unlock_mutex(input_mutex);
+			return;
+		}
+		if (input_searching) {
+			ponder_clock(input_engine, s);
+			if (hit_command(input_engine, s)) {
+				input_engine->ponder_hit = TRUE;
+				signal_cond(input_cond);
+				unlock_mutex(input_mutex);
+				continue;
+			}
+			if (stop_command(input_engine, s))
+				input_engine->stop_search = TRUE;
+			else if (!strncmp(s, "isready", 7)) {
+				printf("readyok\n");
+				fflush(stdout);
+				unlock_mutex(input_mutex);
+				continue;
+			}
+		}
+		l = (line_t *)malloc(sizeof(line_t) + strlen(s));
+		if (!l) {
+			printf("Can't allocate memory for input.\n");
+			exit(1);
+		}
+		strcpy(l->s, s);
+		l->next = NULL;
+		if (input_tail)
+			input_tail->next = l;
+		else
+			input_head = l;
+		input_tail = l;
+		signal_cond(input_cond);
+		unlock_mutex(input_mutex);
+	}
+}
+
+
+/* stop_command() returns TRUE if the line s is a command that stops
+   engine e's search */
+
+BOOL stop_command(engine_t *e, char *s)
+{
+	char command[16];
+
+	if (sscanf(s, "%15s", command) != 1)
+		return FALSE;
+	if (e->pondering && !e->ponder_hit)
+		return strcmp(command, "isready") && strcmp(command, "time") &&
+				strcmp(command, "otim");
+	return !strcmp(command, "stop") || !strcmp(command, "?") ||
+			!strcmp(command, "quit");
+}
+
+
+/* ponder_clock() remembers the engine's time left if the line s is
+   xboard's time command and engine e is pondering, so the search can
+   use it after a ponder hit (see checkup()). */
+
+void ponder_clock(engine_t *e, char *s)
+{
+	int n;
+
+	if (e->pondering && !e->ponder_hit && sscanf(s, "time %d", &n) == 1)
+		e->ponder_time = n * 10;
+}
+
+
+/* hit_command() returns TRUE if the line s is a ponder hit for engine
+   e, i.e., e is pondering and s is "ponderhit" or the move e is
+   pondering on. */
+
+BOOL hit_command(engine_t *e, char *s)
+{
+	char command[16];
+	char move[8];
+
+	if (!e->pondering || e->ponder_hit ||
+			sscanf(s, "%15s", command) != 1)
+		return FALSE;
+	if (!strcmp(command, "ponderhit"))
+		return TRUE;
+	return e->ponder_move.u &&
+			!strcmp(command, move_to_str(e->ponder_move.b, move));
+}
+
+
+/* get_line() waits for the next line of input and copies it to s
+   (with at most size - 1 characters). It returns FALSE at the end of
+   the input. */
+
+BOOL get_line(char *s, int size)
+{
+	line_t *l;
+
+	lock_mutex(input_mutex);
+	while (!input_head && !input_eof)
+		wait_cond(input_cond, input_mutex);
+	l = input_head;
+	if (l) {
+		input_head = l->next;
+		if (!input_head)
+			input_tail = NULL;
+	}
+	unlock_mutex(input_mutex);
+	if (!l)
+		return FALSE;
+	strncpy(s, l->s, size - 1);
+	s[size - 1] = '\0';
+	free(l);
+	return TRUE;
+}
+
+
+/* input_search() tells the input thread that engine e started
+   (searching is TRUE) or finished a search. */
+
+void input_search(engine_t *e, BOOL searching)
+{
+	line_t *l;
+	line_t **p;
+
+	if (e != input_engine)
+		return;
+	lock_mutex(input_mutex);
+	input_searching = searching;
+	if (searching) {
+		input_tail = NULL;
+		for (p = &input_head; *p; ) {
+			l = *p;
+			ponder_clock(e, l->s);
+			if (hit_command(e, l->s)) {
+				e->ponder_hit = TRUE;
+				*p = l->next;
+				free(l);
+				continue;
+			}
+			if (stop_command(e, l->s))
+				e->stop_search = TRUE;
+			input_tail = l;
+			p = &l->next;
+		}
+	}
+	unlock_mutex(input_mutex);
+}
+
+
+/* wait_stop() waits until engine e, which has finished its search but
+   is pondering or searching infinitely, gets its ponder hit or is
+   stopped. */
+
+void wait_stop(engine_t *e)
+{
+	if (e != input_engine)
+		return;
+	lock_mutex(input_mutex);
+	while (((e->pondering && !e->ponder_hit) || e->infinite) &&
+			!e->stop_search && !input_eof)
+		wait_cond(input_cond, input_mutex);
+	unlock_mutex(input_mutex);
+}
@@ -6,6 +6,11 @@
  */
 
 
+#ifdef _WIN32
+#include <windows.h>  /* before defs.h; see thread.c */
+#else
+#include <time.h>
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,30 +20,103 @@
 #include "protos.h"
 
 
-/* get_ms() returns the milliseconds elapsed since midnight,
-   January 1, 1970. */
+/* get_ns() returns the nanoseconds elapsed since some time in the past.
+   It uses a monotonic clock, which, unlike the time of day, never jumps
+   when somebody sets the clock, and has a much better resolution than
+   a millisecond. */
+
+U64 get_ns()
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER t;
+
+	if (!freq.QuadPart)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&t);
+	return (U64)(t.QuadPart / freq.QuadPart) * 1000000000ULL +
+			(U64)(t.QuadPart % freq.QuadPart) * 1000000000ULL / freq.QuadPart;
+#else
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (U64)t.tv_sec * 1000000000ULL + t.tv_nsec;
+#endif
+}
+
+
+/* get_ms() returns the milliseconds elapsed since the program started.
+   (Counting from the program's start keeps the number small enough
+   for an int.) */
+
+U64 clock_start;
 
-#include <sys/timeb.h>
-BOOL ftime_ok = FALSE;  /* does ftime return milliseconds? */
 int get_ms()
 {
-	struct timeb timebuffer;
-	ftime(&timebuffer);
-	if (timebuffer.millitm != 0)
-		ftime_ok = TRUE;
-	return (timebuffer.time * 1000) + timebuffer.millitm;
+	return (int)((get_ns() - clock_start) / 1000000);
 }
 
 
 /* main() is basically an infinite loop that either calls
    think() when it's the computer's turn to move or prompts
-   the user for a command (and deciphers it). */
+   the user for a command (and deciphers it).
+
+   "tscp batch [threads n] [hash n] [sd n] [st n] [sn n] [file]"
+   runs batch mode (see batch.c) on file, or on stdin if there's no
+   file, and exits.
 
-int main()
+   "tscp makebook [in] [out]" makes the book file out (book.bin) from
+   the text book in (book.txt) and exits. The makefile does this. */
+
+int main(int argc, char *argv[])
 {
+	engine_t *e;
 	int computer_side;
-	char s[256];
+	char line[256], s[256], arg[256];
 	int m;
+	int n;
+	int perft_mb = 0;  /* the size of perft's hash table */
+	int t;
+	U64 count;
+
+	clock_start = get_ns();
+	if (argc > 1 && !strcmp(argv[1], "batch")) {
+		init_hash();
+		init_bitboards();
+		init_eval();
+		e = new_engine(16);
+		for (n = 2; n + 1 < argc; n += 2) {
+			if (!strcmp(argv[n], "threads"))
+				set_threads(e, atoi(argv[n + 1]));
+			else if (!strcmp(argv[n], "hash"))
+				alloc_tt(e->tt, atoi(argv[n + 1]));
+			else if (!strcmp(argv[n], "sd"))
+				e->max_depth = atoi(argv[n + 1]);
+			else if (!strcmp(argv[n], "st")) {
+				e->max_time = atoi(argv[n + 1]) * 1000;
+				e->max_depth = 32;
+			}
+			else if (!strcmp(argv[n], "sn")) {
+				e->max_nodes = atoi(argv[n + 1]);
+				e->max_depth = 32;
+			}
+			else
+				break;
+		}
+		batch(e, n < argc ? argv[n] : "-");
+		free_engine(e);
+		return 0;
+	}
+	if (argc > 1 && !strcmp(argv[1], "makebook")) {
+		init_hash();
+		init_bitboards();
+		init_eval();
+		if (!make_book(argc > 2 ? argv[2] : "book.txt", argc > 3 ? argv[3] : "book.bin")) {
+			printf("Can't make the book.\n");
+			return 1;
+		}
+		return 0;
+	}
 
 	printf("\n");
 	printf("Tom Kerrigan's Simple Chess Program (TSCP)\n");
@@ -48,36 +126,42 @@ int main()
 	printf("\"help\" displays a list of commands.\n");
 	printf("\n");
 	init_hash();
-	init_board();
+	init_bitboards();
+	init_eval();
+	e = new_engine(16);
 	open_book();
-	gen();
+	start_input(e);
+	gen(e);
 	computer_side = EMPTY;
-	max_time = 1 << 25;
-	max_depth = 4;
 	for (;;) {
-		if (side == computer_side) {  /* computer's turn */
+		if (e->side == computer_side) {  /* computer's turn */
 			
 			/* think about the move and make it */
-			think(1);
-			if (!pv[0][0].u) {
+			think(e, 1);
+			if (!e->pv[0][0].u) {
 				printf("(no legal moves)\n");
 				computer_side = EMPTY;
 				continue;
 			}
-			printf("Computer's move: %s\n", move_str(pv[0][0].b));
-			makemove(pv[0][0].b);
-			ply = 0;
-			gen();
-			print_result();
+			printf("Computer's move: %s\n", move_str(e->pv[0][0].b));
+			makemove(e, e->pv[0][0].b);
+			e->ply = 0;
+			gen(e);
+			print_result(e);
 			continue;
 		}
 
 		/* get user input */
 		printf("tscp> ");
-		if (scanf("%s", s) == EOF)
-			return 0;
+		fflush(stdout);
+		if (!get_line(line, sizeof(line)))
+			break;
+		if (sscanf(line, "%255s", s) != 1)
+			continue;
+		if (!strcmp(s, "stop"))  /* too late; the search is over */
+			continue;
 		if (!strcmp(s, "on")) {
-			computer_side = side;
+			computer_side = e->side;
 			continue;
 		}
 		if (!strcmp(s, "off")) {
@@ -85,38 +169,127 @@ int main()
 			continue;
 		}
 		if (!strcmp(s, "st")) {
-			scanf("%d", &max_time);
-			max_time *= 1000;
-			max_depth = 32;
+			sscanf(line, "%*s %d", &e->max_time);
+			e->max_time *= 1000;
+			e->soft_time = 0;
+			e->max_depth = 32;
+			e->max_nodes = 0;
 			continue;
 		}
 		if (!strcmp(s, "sd")) {
-			scanf("%d", &max_depth);
-			max_time = 1 << 25;
+			sscanf(line, "%*s %d", &e->max_depth);
+			e->max_time = 1 << 25;
+			e->soft_time = 0;
+			e->max_nodes = 0;
+			continue;
+		}
+		if (!strcmp(s, "sn")) {
+			sscanf(line, "%*s %d", &e->max_nodes);
+			e->max_time = 1 << 25;
+			e->soft_time = 0;
+			e->max_depth = 32;
+			continue;
+		}
+		if (!strcmp(s, "prune")) {
+			if (sscanf(line, "%*s %255s %255s", s, arg) == 2 && sel_flag(s)) {
+				if (!strcmp(arg, "on"))
+					e->selective |= sel_flag(s);
+				else if (!strcmp(arg, "off"))
+					e->selective &= ~sel_flag(s);
+			}
+			printf("null %s, lmr %s, futility %s, razor %s\n",
+					e->selective & SEL_NULL ? "on" : "off",
+					e->selective & SEL_LMR ? "on" : "off",
+					e->selective & SEL_FUTILITY ? "on" : "off",
+					e->selective & SEL_RAZOR ? "on" : "off");
+			continue;
+		}
+		if (!strcmp(s, "hash")) {
+			if (sscanf(line, "%*s %d", &n) != 1)
+				continue;
+			alloc_tt(e->tt, n);
+			continue;
+		}
+		if (!strcmp(s, "threads")) {
+			if (sscanf(line, "%*s %d", &n) != 1)
+				continue;
+			set_threads(e, n);
+			continue;
+		}
+		if (!strcmp(s, "multipv")) {
+			if (sscanf(line, "%*s %d", &n) != 1)
+				continue;
+			set_multipv(e, n);
 			continue;
 		}
 		if (!strcmp(s, "undo")) {
-			if (!hply)
+			if (!e->hply)
 				continue;
 			computer_side = EMPTY;
-			takeback();
-			ply = 0;
-			gen();
+			takeback(e);
+			e->ply = 0;
+			gen(e);
 			continue;
 		}
 		if (!strcmp(s, "new")) {
 			computer_side = EMPTY;
-			init_board();
-			gen();
+			init_board(e);
+			clear_tt(e->tt);
+			gen(e);
+			continue;
+		}
+		if (!strcmp(s, "setboard")) {
+			computer_side = EMPTY;
+			if (!set_fen(e, line + 9))
+				printf("Illegal position.\n");
+			clear_tt(e->tt);
+			gen(e);
+			continue;
+		}
+		if (!strcmp(s, "makebook")) {
+			strcpy(s, "book.txt");
+			sscanf(line, "%*s %255s", s);
+			close_book();
+			if (!make_book(s, "book.bin"))
+				printf("Can't make the book from %s.\n", s);
+			open_book();
+			continue;
+		}
+		if (!strcmp(s, "batch")) {
+			sscanf(line, "%*s %255s", s);
+			batch(e, s);
+			continue;
+		}
+		if (!strcmp(s, "epd")) {
+			sscanf(line, "%*s %255s", s);
+			computer_side = EMPTY;
+			epd_suite(e, s);
 			continue;
 		}
 		if (!strcmp(s, "d")) {
-			print_board();
+			print_board(e);
 			continue;
 		}
 		if (!strcmp(s, "bench")) {
 			computer_side = EMPTY;
-			bench();
+			bench(e);
+			continue;
+		}
+		if (!strcmp(s, "perft") || !strcmp(s, "divide")) {
+			if (sscanf(line, "%*s %d", &n) != 1)
+				continue;
+			t = get_ms();
+			count = perft_root(e, n, !strcmp(s, "divide"), perft_mb);
+			t = get_ms() - t;
+			printf("Nodes: %llu\n", count);
+			printf("Time: %d ms\n", t);
+			if (t)
+				printf("Nodes per second: %.0f\n", (double)count * 1000.0 / t);
+			gen(e);
+			continue;
+		}
+		if (!strcmp(s, "perfthash")) {
+			sscanf(line, "%*s %d", &perft_mb);
 			continue;
 		}
 		if (!strcmp(s, "bye")) {
@@ -124,7 +297,11 @@ int main()
 			break;
 		}
 		if (!strcmp(s, "xboard")) {
-			xboard();
+			xboard(e);
+			break;
+		}
+		if (!strcmp(s, "uci")) {
+			uci(e);
 			break;
 		}
 		if (!strcmp(s, "help")) {
@@ -132,26 +309,44 @@ int main()
 			printf("off - computer stops playing\n");
 			printf("st n - search for n seconds per move\n");
 			printf("sd n - search n ply per move\n");
+			printf("sn n - search n nodes per move\n");
+			printf("hash n - use an n MB hash table\n");
+			printf("threads n - search with n threads\n");
+			printf("multipv n - show the best n moves, each with its PV\n");
+			printf("prune null|lmr|futility|razor on|off - switch parts of\n");
+			printf("    the selective search on or off\n");
 			printf("undo - takes back a move\n");
 			printf("new - starts a new game\n");
+			printf("setboard fen - set up the position fen\n");
 			printf("d - display the board\n");
 			printf("bench - run the built-in benchmark\n");
+			printf("perft n - count the positions n ply from here\n");
+			printf("divide n - perft, with the count for each move\n");
+			printf("perfthash n - give perft an n MB hash table (0 = none)\n");
+			printf("epd file - run the EPD test suite in file\n");
+			printf("batch file - analyze the FENs in file, printing JSON\n");
+			printf("makebook [file] - make book.bin from file (book.txt)\n");
 			printf("bye - exit the program\n");
 			printf("xboard - switch to XBoard mode\n");
-			printf("Enter moves in coordinate notation, e.g., e2e4, e7e8Q\n");
+			printf("uci - switch to UCI mode\n");
+			printf("Enter moves in coordinate notation, e.g., e2e4, e7e8Q,\n");
+			printf("or in SAN, e.g., e4, Nf3, O-O\n");
 			continue;
 		}
 
 		/* maybe the user entered a move? */
-		m = parse_move(s);
-		if (m == -1 || !makemove(gen_dat[m].m.b))
+		m = parse_move(e, s);
+		if (m == -1)
+			m = parse_san(e, s);
+		if (m == -1 || !makemove(e, e->gen_dat[m].m.b))
 			printf("Illegal move.\n");
 		else {
-			ply = 0;
-			gen();
-			print_result();
+			e->ply = 0;
+			gen(e);
+			print_result(e);
 		}
 	}
+	stop_input();
 	close_book();
 	return 0;
 }
@@ -160,7 +355,7 @@ int main()
 /* parse the move s (in coordinate notation) and return the move's
    index in gen_dat, or -1 if the move is illegal */
 
-int parse_move(char *s)
+int parse_move(engine_t *e, char *s)
 {
 	int from, to, i;
 
@@ -176,13 +371,13 @@ int parse_move(char *s)
 	to = s[2] - 'a';
 	to += 8 * (8 - (s[3] - '0'));
 
-	for (i = 0; i < first_move[1]; ++i)
-		if (gen_dat[i].m.b.from == from && gen_dat[i].m.b.to == to) {
+	for (i = 0; i < e->first_move[1]; ++i)
+		if (e->gen_dat[i].m.b.from == from && e->gen_dat[i].m.b.to == to) {
 
 			/* if the move is a promotion, handle the promotion piece;
 			   assume that the promotion moves occur consecutively in
 			   gen_dat. */
-			if (gen_dat[i].m.b.bits & 32)
+			if (e->gen_dat[i].m.b.bits & 32)
 				switch (s[4]) {
 					case 'N':
 					case 'n':
@@ -210,6 +405,15 @@ char *move_str(move_bytes m)
 {
 	static char str[6];
 
+	return move_to_str(m, str);
+}
+
+
+/* move_to_str() is the same, but it writes the string to str, so more
+   than one thread can use it at a time */
+
+char *move_to_str(move_bytes m, char *str)
+{
 	char c;
 
 	if (m.bits & 32) {
@@ -227,40 +431,158 @@ char *move_str(move_bytes m)
 				c = 'q';
 				break;
 		}
-		sprintf(str, "%c%d%c%d%c",
+		sprintf(str, "%c%c%c%c%c",
 				COL(m.from) + 'a',
-				8 - ROW(m.from),
+				'8' - ROW(m.from),
 				COL(m.to) + 'a',
-				8 - ROW(m.to),
+				'8' - ROW(m.to),
 				c);
 	}
 	else
-		sprintf(str, "%c%d%c%d",
+		sprintf(str, "%c%c%c%c",
 				COL(m.from) + 'a',
-				8 - ROW(m.from),
+				'8' - ROW(m.from),
 				COL(m.to) + 'a',
-				8 - ROW(m.to));
+				'8' - ROW(m.to));
 	return str;
 }
 
 
+/* move_san() returns a string with move m in Standard Algebraic
+   Notation, e.g., "Nbd2", "exd5", "e8=Q+", or "O-O". m must be a legal
+   move in the current position. To find out if the piece's file or
+   rank needs to be given, we look for other pieces of the same kind
+   that could legally move to the same square. */
+
+char *move_san(engine_t *e, move_bytes m)
+{
+	static char str[12];
+	int p = e->piece[(int)m.from];
+	int i, n = 0;
+	BOOL same_file = FALSE, same_rank = FALSE, others = FALSE;
+	U64 b;
+	move o;  /* the same move by another piece */
+
+	if (m.bits & 2) {
+		strcpy(str, COL(m.to) == 6 ? "O-O" : "O-O-O");
+		n = (int)strlen(str);
+	}
+	else {
+		if (p != PAWN) {
+			str[n++] = piece_char[p];
+
+			/* the other pieces of the same kind that attack m.to */
+			for (b = e->bb_piece[e->side][p] & ~BIT(m.from); b; b &= b - 1) {
+				o.b = m;
+				o.b.from = (char)LSB(b);
+				if (!move_ok(e, o) || !makemove(e, o.b))
+					continue;
+				takeback(e);
+				others = TRUE;
+				if (COL(o.b.from) == COL(m.from))
+					same_file = TRUE;
+				if (ROW(o.b.from) == ROW(m.from))
+					same_rank = TRUE;
+			}
+			if (others) {
+				if (!same_file)
+					str[n++] = (char)(COL(m.from) + 'a');
+				else if (!same_rank)
+					str[n++] = (char)(8 - ROW(m.from) + '0');
+				else {
+					str[n++] = (char)(COL(m.from) + 'a');
+					str[n++] = (char)(8 - ROW(m.from) + '0');
+				}
+			}
+		}
+		if (m.bits & 1) {
+			if (p == PAWN)
+				str[n++] = (char)(COL(m.from) + 'a');
+			str[n++] = 'x';
+		}
+		str[n++] = (char)(COL(m.to) + 'a');
+		str[n++] = (char)(8 - ROW(m.to) + '0');
+		if (m.bits & 32) {
+			str[n++] = '=';
+			str[n++] = piece_char[(int)m.promote];
+		}
+	}
+
+	/* add + for check or # for checkmate */
+	if (makemove(e, m)) {
+		if (in_check(e, e->side)) {
+			gen(e);
+			for (i = e->first_move[e->ply]; i < e->first_move[e->ply + 1]; ++i)
+				if (makemove(e, e->gen_dat[i].m.b)) {
+					takeback(e);
+					break;
+				}
+			str[n++] = i < e->first_move[e->ply + 1] ? '+' : '#';
+		}
+		takeback(e);
+	}
+	str[n] = '\0';
+	return str;
+}
+
+
+/* parse_san() is like parse_move(), but for a move in Standard
+   Algebraic Notation. It's lenient about the things that people
+   (and EPD files) leave out or add: check and annotation symbols,
+   the '=' before a promotion piece, and "0-0" for "O-O". */
+
+int parse_san(engine_t *e, char *s)
+{
+	char want[16], have[16];
+	int i;
+
+	san_strip(s, want);
+	for (i = e->first_move[e->ply]; i < e->first_move[e->ply + 1]; ++i) {
+		if (!makemove(e, e->gen_dat[i].m.b))
+			continue;
+		takeback(e);
+		san_strip(move_san(e, e->gen_dat[i].m.b), have);
+		if (!strcmp(want, have))
+			return i;
+	}
+	return -1;
+}
+
+
+/* san_strip() copies the SAN move in s to t without the check and
+   annotation symbols and the '=' of a promotion, and with the zeros of
+   "0-0" changed to O's. s ends at the first space or semicolon. */
+
+void san_strip(char *s, char *t)
+{
+	int n = 0;
+
+	for (; *s && *s != ' ' && *s != ';' && n < 15; ++s)
+		if (*s == '0')
+			t[n++] = 'O';
+		else if (!strchr("+#!?=", *s))
+			t[n++] = *s;
+	t[n] = '\0';
+}
+
+
 /* print_board() prints the board */
 
-void print_board()
+void print_board(engine_t *e)
 {
 	int i;
 	
 	printf("\n8 ");
 	for (i = 0; i < 64; ++i) {
-		switch (color[i]) {
+		switch (e->color[i]) {
 			case EMPTY:
 				printf(" .");
 				break;
 			case LIGHT:
-				printf(" %c", piece_char[piece[i]]);
+				printf(" %c", piece_char[e->piece[i]]);
 				break;
 			case DARK:
-				printf(" %c", piece_char[piece[i]] + ('a' - 'A'));
+				printf(" %c", piece_char[e->piece[i]] + ('a' - 'A'));
 				break;
 		}
 		if ((i + 1) % 8 == 0 && i != 63)
@@ -274,43 +596,68 @@ void print_board()
    and WinBoard compatible. See the following page for details:
    http://www.research.digital.com/SRC/personal/mann/xboard/engine-intf.html */
 
-void xboard()
+void xboard(engine_t *e)
 {
 	int computer_side;
 	char line[256], command[256];
 	int m;
+	int n;
 	int post = 0;
+	BOOL ponder = FALSE;  /* ponder on the opponent's time? */
+	BOOL pondered = FALSE;  /* did pondering already find our move? */
+	move expect;  /* the move we expect the opponent to make */
+	int mps = 0;  /* moves per time control (0 = the whole game) */
+	int inc = 0;  /* increment in milliseconds */
+	double d = 0;
 
 	signal(SIGINT, SIG_IGN);
 	printf("\n");
-	init_board();
-	gen();
+	init_board(e);
+	gen(e);
 	computer_side = EMPTY;
+	expect.u = 0;
 	for (;;) {
 		fflush(stdout);
-		if (side == computer_side) {
-			think(post);
-			if (!pv[0][0].u) {
+		if (e->side == computer_side) {
+			if (!pondered)
+				think(e, post);
+			pondered = FALSE;
+			if (!e->pv[0][0].u) {
 				computer_side = EMPTY;
 				continue;
 			}
-			printf("move %s\n", move_str(pv[0][0].b));
-			makemove(pv[0][0].b);
-			ply = 0;
-			gen();
-			print_result();
+			expect.u = 0;
+			if (ponder)
+				expect = expected_reply(e);
+			printf("move %s\n", move_str(e->pv[0][0].b));
+			makemove(e, e->pv[0][0].b);
+			e->ply = 0;
+			gen(e);
+			print_result(e);
+			continue;
+		}
+		if (ponder && expect.u && computer_side != EMPTY) {
+			pondered = xboard_ponder(e, expect, post, inc,
+					mps == -1 ? -1 : mps ? mps - (e->hply / 2) % mps : 0);
+			expect.u = 0;
 			continue;
 		}
-		if (!fgets(line, 256, stdin))
+		if (!get_line(line, sizeof(line)))
 			return;
 		if (line[0] == '\n')
 			continue;
 		sscanf(line, "%s", command);
 		if (!strcmp(command, "xboard"))
 			continue;
+		if (!strcmp(command, "protover")) {
+			printf("feature setboard=1 option=\"MultiPV -spin 1 1 %d\" done=1\n",
+					MAX_MULTIPV);
+			continue;
+		}
 		if (!strcmp(command, "new")) {
-			init_board();
-			gen();
+			init_board(e);
+			clear_tt(e->tt);
+			gen(e);
 			computer_side = DARK;
 			continue;
 		}
@@ -321,104 +668,421 @@ void xboard()
 			continue;
 		}
 		if (!strcmp(command, "white")) {
-			side = LIGHT;
-			xside = DARK;
-			gen();
+			e->side = LIGHT;
+			e->xside = DARK;
+			set_hash(e);
+			gen(e);
 			computer_side = DARK;
 			continue;
 		}
 		if (!strcmp(command, "black")) {
-			side = DARK;
-			xside = LIGHT;
-			gen();
+			e->side = DARK;
+			e->xside = LIGHT;
+			set_hash(e);
+			gen(e);
 			computer_side = LIGHT;
 			continue;
 		}
 		if (!strcmp(command, "st")) {
-			sscanf(line, "st %d", &max_time);
-			max_time *= 1000;
-			max_depth = 32;
+			sscanf(line, "st %d", &e->max_time);
+			e->max_time *= 1000;
+			e->soft_time = 0;
+			e->max_depth = 32;
+			mps = -1;
 			continue;
 		}
 		if (!strcmp(command, "sd")) {
-			sscanf(line, "sd %d", &max_depth);
-			max_time = 1 << 25;
+			sscanf(line, "sd %d", &e->max_depth);
+			e->max_time = 1 << 25;
+			e->soft_time = 0;
+			mps = -1;
+			continue;
+		}
+		if (!strcmp(command, "level")) {
+			d = 0;
+			sscanf(line, "level %d %*s %lf", &mps, &d);
+			inc = (int)(d * 1000);
+			continue;
+		}
+		if (!strcmp(command, "setboard")) {
+			if (!set_fen(e, line + 9))
+				printf("tellusererror Illegal position\n");
+			gen(e);
 			continue;
 		}
 		if (!strcmp(command, "time")) {
-			sscanf(line, "time %d", &max_time);
-			max_time *= 10;
-			max_time /= 30;
-			max_depth = 32;
+			if (mps == -1 || sscanf(line, "time %d", &n) != 1)
+				continue;  /* st or sd overrides the clock */
+			set_clock(e, n * 10, inc,
+					mps ? mps - (e->hply / 2) % mps : 0);
+			e->max_depth = 32;
 			continue;
 		}
+		if (!strcmp(command, "?"))  /* handled by the input thread */
+			continue;
 		if (!strcmp(command, "otim")) {
 			continue;
 		}
+		if (!strcmp(command, "memory")) {
+			sscanf(line, "memory %d", &n);
+			alloc_tt(e->tt, n);
+			continue;
+		}
+		if (!strcmp(command, "option")) {
+			if (sscanf(line, "option MultiPV=%d", &n) == 1)
+				set_multipv(e, n);
+			continue;
+		}
+		if (!strcmp(command, "threads") || !strcmp(command, "cores")) {
+			sscanf(line, "%*s %d", &n);
+			set_threads(e, n);
+			continue;
+		}
 		if (!strcmp(command, "go")) {
-			computer_side = side;
+			computer_side = e->side;
 			continue;
 		}
 		if (!strcmp(command, "hint")) {
-			think(0);
-			if (!pv[0][0].u)
+			think(e, 0);
+			if (!e->pv[0][0].u)
 				continue;
-			printf("Hint: %s\n", move_str(pv[0][0].b));
+			printf("Hint: %s\n", move_str(e->pv[0][0].b));
 			continue;
 		}
 		if (!strcmp(command, "undo")) {
-			if (!hply)
+			if (!e->hply)
 				continue;
-			takeback();
-			ply = 0;
-			gen();
+			takeback(e);
+			e->ply = 0;
+			gen(e);
 			continue;
 		}
 		if (!strcmp(command, "remove")) {
-			if (hply < 2)
+			if (e->hply < 2)
 				continue;
-			takeback();
-			takeback();
-			ply = 0;
-			gen();
+			takeback(e);
+			takeback(e);
+			e->ply = 0;
+			gen(e);
 			continue;
 		}
 		if (!strcmp(command, "post")) {
 			post = 2;
 			continue;
 		}
+		if (!strcmp(command, "hard")) {
+			ponder = TRUE;
+			continue;
+		}
+		if (!strcmp(command, "easy")) {
+			ponder = FALSE;
+			continue;
+		}
 		if (!strcmp(command, "nopost")) {
 			post = 0;
 			continue;
 		}
-		m = parse_move(line);
-		if (m == -1 || !makemove(gen_dat[m].m.b))
+		m = parse_move(e, line);
+		if (m == -1 || !makemove(e, e->gen_dat[m].m.b))
 			printf("Error (unknown command): %s\n", command);
 		else {
-			ply = 0;
-			gen();
-			print_result();
+			e->ply = 0;
+			gen(e);
+			print_result(e);
+		}
+	}
+}
+
+
+/* xboard_ponder() ponders on move m, the move we expect the opponent
+   to make: it makes m and searches the position after it until the
+   opponent moves. If the opponent makes m, the search goes on as the
+   search for our move (see think()), and xboard_ponder() returns TRUE
+   when it's done. Otherwise, it takes m back and returns FALSE, and
+   the opponent's move is still waiting to be read.
+
+   xboard sends our time left right before the opponent's move, so the
+   search gets it while it's still pondering. inc and movestogo are the
+   other set_clock() arguments for our move, which checkup() uses with
+   that time on a ponder hit (movestogo is -1 if the clock doesn't
+   apply because of an st or sd command). */
+
+BOOL xboard_ponder(engine_t *e, move m, int post, int inc, int movestogo)
+{
+	if (!move_ok(e, m) || !makemove(e, m.b))
+		return FALSE;
+	e->ply = 0;
+	e->ponder_move = m;
+	e->ponder_inc = inc;
+	e->ponder_movestogo = movestogo;
+	e->pondering = TRUE;
+	think(e, post);
+	e->ponder_move.u = 0;
+	if (e->ponder_hit) {
+		gen(e);
+		print_result(e);
+		return TRUE;
+	}
+	takeback(e);
+	e->ply = 0;
+	gen(e);
+	return FALSE;
+}
+
+
+/* sel_flag() returns the SEL_ flag for a part of the selective search,
+   by its name in the prune command or its UCI option, or 0 if there's
+   no such part */
+
+int sel_flag(char *name)
+{
+	if (!strcmp(name, "null") || !strcmp(name, "NullMove"))
+		return SEL_NULL;
+	if (!strcmp(name, "lmr") || !strcmp(name, "LMR"))
+		return SEL_LMR;
+	if (!strcmp(name, "futility") || !strcmp(name, "Futility"))
+		return SEL_FUTILITY;
+	if (!strcmp(name, "razor") || !strcmp(name, "Razoring"))
+		return SEL_RAZOR;
+	return 0;
+}
+
+
+/* uci() is a substitute for main() that speaks the Universal Chess
+   Interface (UCI) protocol. See the following page for details:
+   http://wbec-ridderkerk.nl/html/UCIProtocol.html
+
+   Unlike XBoard, UCI doesn't keep a game going: every search gets
+   the whole position (usually the starting position and the moves
+   since then) in a "position" command, and the limits for the search
+   in the "go" command that follows. */
+
+void uci(engine_t *e)
+{
+	char line[8192], command[256];
+
+	signal(SIGINT, SIG_IGN);
+	uci_id();
+	init_board(e);
+	gen(e);
+	for (;;) {
+		fflush(stdout);
+		if (!get_line(line, sizeof(line)))
+			return;
+		if (sscanf(line, "%255s", command) != 1)
+			continue;
+		if (!strcmp(command, "uci")) {
+			uci_id();
+			continue;
+		}
+		if (!strcmp(command, "isready")) {
+			printf("readyok\n");
+			continue;
+		}
+		if (!strcmp(command, "ucinewgame")) {
+			init_board(e);
+			clear_tt(e->tt);
+			gen(e);
+			continue;
+		}
+		if (!strcmp(command, "setoption")) {
+			uci_option(e, line);
+			continue;
+		}
+		if (!strcmp(command, "position")) {
+			uci_position(e, line);
+			continue;
+		}
+		if (!strcmp(command, "go")) {
+			uci_go(e, line);
+			continue;
+		}
+		if (!strcmp(command, "quit"))
+			return;
+
+		/* stop and ponderhit only mean something during a search, and
+		   the others (debug, register) we don't support */
+	}
+}
+
+
+/* uci_id() answers the "uci" command */
+
+void uci_id()
+{
+	printf("id name TSCP 1.81b\n");
+	printf("id author Tom Kerrigan\n");
+	printf("option name Hash type spin default 16 min 1 max 4096\n");
+	printf("option name Threads type spin default 1 min 1 max %d\n", MAX_THREADS);
+	printf("option name Ponder type check default false\n");
+	printf("option name MultiPV type spin default 1 min 1 max %d\n", MAX_MULTIPV);
+	printf("option name NullMove type check default true\n");
+	printf("option name LMR type check default true\n");
+	printf("option name Futility type check default true\n");
+	printf("option name Razoring type check default true\n");
+	printf("uciok\n");
+}
+
+
+/* uci_option() handles "setoption name <name> value <value>" */
+
+void uci_option(engine_t *e, char *line)
+{
+	char name[256], value[256];
+	int n;
+
+	if (sscanf(line, "setoption name %255s value %255s", name, value) != 2)
+		return;
+	n = atoi(value);
+	if (!strcmp(name, "Hash"))
+		alloc_tt(e->tt, n);
+	else if (!strcmp(name, "Threads"))
+		set_threads(e, n);
+	else if (!strcmp(name, "MultiPV"))
+		set_multipv(e, n);
+	else {
+		n = sel_flag(name);
+		if (!strcmp(value, "true"))
+			e->selective |= n;
+		else
+			e->selective &= ~n;
+	}
+}
+
+
+/* uci_position() handles "position [startpos | fen <fen>] [moves <moves>]" */
+
+void uci_position(engine_t *e, char *line)
+{
+	char *p;
+	int m;
+
+	p = strstr(line, " moves");
+	if (p)
+		*p++ = '\0';
+	if (!strncmp(line, "position fen ", 13)) {
+		if (!set_fen(e, line + 13)) {
+			printf("info string Illegal position\n");
+			init_board(e);
 		}
 	}
+	else
+		init_board(e);
+	gen(e);
+	if (!p)
+		return;
+
+	/* make the moves */
+	for (p = strtok(p + 5, " \t\r\n"); p; p = strtok(NULL, " \t\r\n")) {
+		if (e->hply >= HIST_STACK - MAX_PLY)
+			break;
+		m = parse_move(e, p);
+		if (m == -1 || !makemove(e, e->gen_dat[m].m.b))
+			break;
+		e->ply = 0;
+		gen(e);
+	}
+}
+
+
+/* uci_go() handles "go" with its search limits, searches, and prints
+   the best move. Without a clock (wtime/btime), it searches until it
+   reaches the depth, node, or time limit it's given, or forever if it
+   isn't given one. With a clock, set_clock() decides how long to
+   search. */
+
+void uci_go(engine_t *e, char *line)
+{
+	char *p, *q;
+	int time = -1, inc = 0, movestogo = 0;
+	int n;
+	move m;
+
+	e->max_time = 1 << 25;
+	e->soft_time = 0;
+	e->max_depth = 32;
+	e->max_nodes = 0;
+	strtok(line, " \t\r\n");  /* skip "go" */
+	for (p = strtok(NULL, " \t\r\n"); p; p = strtok(NULL, " \t\r\n")) {
+		if (!strcmp(p, "ponder"))
+			e->pondering = TRUE;
+		if (!strcmp(p, "infinite"))
+			e->infinite = TRUE;
+		if (!strcmp(p, "infinite") || !strcmp(p, "ponder"))
+			continue;
+		q = strtok(NULL, " \t\r\n");
+		if (!q)
+			break;
+		n = atoi(q);
+		if ((!strcmp(p, "wtime") && e->side == LIGHT) ||
+				(!strcmp(p, "btime") && e->side == DARK))
+			time = n;
+		else if ((!strcmp(p, "winc") && e->side == LIGHT) ||
+				(!strcmp(p, "binc") && e->side == DARK))
+			inc = n;
+		else if (!strcmp(p, "movestogo"))
+			movestogo = n;
+		else if (!strcmp(p, "depth") && n > 0)
+			e->max_depth = n < MAX_PLY - 1 ? n : MAX_PLY - 1;
+		else if (!strcmp(p, "nodes"))
+			e->max_nodes = n;
+		else if (!strcmp(p, "movetime"))
+			e->max_time = n;
+	}
+	if (time != -1)
+		set_clock(e, time, inc, movestogo);
+
+	think(e, 3);
+	if (!e->pv[0][0].u) {
+		printf("bestmove 0000\n");
+		return;
+	}
+	printf("bestmove %s", move_str(e->pv[0][0].b));
+	m = expected_reply(e);
+	if (m.u)
+		printf(" ponder %s", move_str(m.b));
+	printf("\n");
+}
+
+
+/* expected_reply() returns the move we expect the opponent to make
+   after our move pv[0][0]: pv[0][1], if it's legal then. Otherwise,
+   or if the PV is too short, it returns 0. */
+
+move expected_reply(engine_t *e)
+{
+	move m;
+
+	m.u = 0;
+	gen(e);
+	if (e->pv_length[0] < 2 || !makemove(e, e->pv[0][0].b))
+		return m;
+	e->first_move[e->ply + 1] = e->first_move[e->ply];  /* for move_ok() */
+	if (move_ok(e, e->pv[0][1]) && makemove(e, e->pv[0][1].b)) {
+		takeback(e);
+		m = e->pv[0][1];
+	}
+	takeback(e);
+	return m;
 }
 
 
 /* print_result() checks to see if the game is over, and if so,
    prints the result. */
 
-void print_result()
+void print_result(engine_t *e)
 {
 	int i;
 
 	/* is there a legal move? */
-	for (i = 0; i < first_move[1]; ++i)
-		if (makemove(gen_dat[i].m.b)) {
-			takeback();
+	for (i = 0; i < e->first_move[1]; ++i)
+		if (makemove(e, e->gen_dat[i].m.b)) {
+			takeback(e);
 			break;
 		}
-	if (i == first_move[1]) {
-		if (in_check(side)) {
-			if (side == LIGHT)
+	if (i == e->first_move[1]) {
+		if (in_check(e, e->side)) {
+			if (e->side == LIGHT)
 				printf("0-1 {Black mates}\n");
 			else
 				printf("1-0 {White mates}\n");
@@ -426,98 +1090,100 @@ void print_result()
 		else
 			printf("1/2-1/2 {Stalemate}\n");
 	}
-	else if (reps() == 2)
+	else if (reps(e) == 2)
 		printf("1/2-1/2 {Draw by repetition}\n");
-	else if (fifty >= 100)
+	else if (e->fifty >= 100)
 		printf("1/2-1/2 {Draw by fifty move rule}\n");
 }
 
 
-/* bench: This is a little benchmark code that calculates how many
-   nodes per second TSCP searches.
-   It sets the position to move 17 of Bobby Fischer vs. J. Sherwin,
-   New Jersey State Open Championship, 9/2/1957.
-   Then it searches five ply three times. It calculates nodes per
-   second from the best time. */
-
-int bench_color[64] = {
-	6, 1, 1, 6, 6, 1, 1, 6,
-	1, 6, 6, 6, 6, 1, 1, 1,
-	6, 1, 6, 1, 1, 6, 1, 6,
-	6, 6, 6, 1, 6, 6, 0, 6,
-	6, 6, 1, 0, 6, 6, 6, 6,
-	6, 6, 0, 6, 6, 6, 0, 6,
-	0, 0, 0, 6, 6, 0, 0, 0,
-	0, 6, 0, 6, 0, 6, 0, 6
+/* bench: This is a little benchmark that measures how fast TSCP
+   searches. It searches each of the positions below (from the opening,
+   the middlegame, tactical positions, and endgames) to a fixed depth
+   with a cleared hash table, and prints the nodes, time, and nodes per
+   second for each one, and the totals.
+
+   It also prints a signature, which is made from the node counts and
+   best moves of all of the positions. The signature only changes when
+   the search itself changes, not when it gets faster or slower, so it
+   tells you whether a change was supposed to affect performance only
+   (the signature stays the same) or also the search. (With more than
+   one thread, the node counts vary from run to run, so the signature
+   does too.) */
+
+char *bench_fen[] = {
+	/* the initial position */
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+	/* the Two Knights Defense */
+	"r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+	/* move 17 of Bobby Fischer vs. J. Sherwin, New Jersey State Open
+	   Championship, 9/2/1957 (the position of the old benchmark) */
+	"1rb2rk1/p4ppp/1p1qp1n1/3n2N1/2pP4/2P3P1/PPQ2PBP/R1B1R1K1 w - - 0 17",
+	/* "Kiwipete," a position that's full of tricky moves */
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+	/* Win at Chess #1 and #2 */
+	"2rr3k/pp3pp1/1nnqbN1p/3pN3/2pP4/2P3Q1/PPB4P/R4RK1 w - - 0 1",
+	"8/7p/5k2/5p2/p1p2P2/Pr1pPK2/1P1R3P/8 b - - 0 1",
+	/* a rook endgame */
+	"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+	/* Lasker-Reichhelm, 1901, a pawn endgame */
+	"8/k7/3p4/p2P1p2/P2P1P2/8/8/K7 w - - 0 1"
 };
 
-int bench_piece[64] = {
-	6, 3, 2, 6, 6, 3, 5, 6,
-	0, 6, 6, 6, 6, 0, 0, 0,
-	6, 0, 6, 4, 0, 6, 1, 6,
-	6, 6, 6, 1, 6, 6, 1, 6,
-	6, 6, 0, 0, 6, 6, 6, 6,
-	6, 6, 0, 6, 6, 6, 0, 6,
-	0, 0, 4, 6, 6, 0, 2, 0,
-	3, 6, 2, 6, 3, 6, 5, 6
+/* the depths are deep enough that the whole bench takes several
+   seconds, so the speed it measures isn't mostly timer noise */
+int bench_depth[] = {
+	12, 12, 11, 11, 16, 16, 17, 30
 };
 
-void bench()
+#define BENCH_POSITIONS		(sizeof(bench_depth) / sizeof(int))
+
+void bench(engine_t *e)
 {
 	int i;
-	int t[3];
-	double nps;
+	int t, total_time = 0;
+	U64 total_nodes = 0;
+	U64 signature = 0;
+	int multipv = e->multipv;
 
 	/* setting the position to a non-initial position confuses the opening
 	   book code. */
 	close_book();
 
-	for (i = 0; i < 64; ++i) {
-		color[i] = bench_color[i];
-		piece[i] = bench_piece[i];
+	/* only the depth limits the searches, and they only look for the
+	   best move, whatever the settings are; otherwise the node counts
+	   and the signature would depend on them */
+	e->max_time = 1 << 25;
+	e->soft_time = 0;
+	e->max_nodes = 0;
+	e->multipv = 1;
+	printf("pos  depth      nodes   time (ms)      nodes/s  move\n");
+	for (i = 0; i < (int)BENCH_POSITIONS; ++i) {
+		set_fen(e, bench_fen[i]);
+		e->max_depth = bench_depth[i];
+		clear_tt(e->tt);  /* so each run does the same work */
+		think(e, 0);
+		t = search_time(e);
+		printf("%3d  %5d  %9d  %10d  %11.0f  %s\n",
+				i + 1, bench_depth[i], e->nodes, t,
+				t ? (double)e->nodes * 1000.0 / t : 0.0,
+				move_str(e->pv[0][0].b));
+		total_nodes += e->nodes;
+		total_time += t;
+		signature = (signature ^ (U64)e->nodes) * 1099511628211ULL;
+		signature = (signature ^ (U64)(unsigned int)e->pv[0][0].u) * 1099511628211ULL;
 	}
-	side = LIGHT;
-	xside = DARK;
-	castle = 0;
-	ep = -1;
-	fifty = 0;
-	ply = 0;
-	hply = 0;
-	set_hash();
-	print_board();
-	max_time = 1 << 25;
-	max_depth = 5;
-	for (i = 0; i < 3; ++i) {
-		think(1);
-		t[i] = get_ms() - start_time;
-		printf("Time: %d ms\n", t[i]);
-	}
-	if (t[1] < t[0])
-		t[0] = t[1];
-	if (t[2] < t[0])
-		t[0] = t[2];
 	printf("\n");
-	printf("Nodes: %d\n", nodes);
-	printf("Best time: %d ms\n", t[0]);
-	if (!ftime_ok) {
-		printf("\n");
-		printf("Your compiler's ftime() function is apparently only accurate\n");
-		printf("to the second. Please change the get_ms() function in main.c\n");
-		printf("to make it more accurate.\n");
-		printf("\n");
-		return;
-	}
-	if (t[0] == 0) {
-		printf("(invalid)\n");
-		return;
-	}
-	nps = (double)nodes / (double)t[0];
-	nps *= 1000.0;
-
-	/* Score: 1.000 = my Athlon XP 2000+ */
-	printf("Nodes per second: %d (Score: %.3f)\n", (int)nps, (float)nps/243169.0);
+	printf("Threads: %d\n", e->threads);
+	printf("Nodes: %llu\n", total_nodes);
+	printf("Time: %d ms\n", total_time);
+	if (total_time)
+		printf("Nodes per second: %.0f\n", (double)total_nodes * 1000.0 / total_time);
+	printf("Signature: %016llx\n", signature);
+	e->multipv = multipv;
 
-	init_board();
+	init_board(e);
+	clear_tt(e->tt);
 	open_book();
-	gen();
+	gen(e);
 }
@@ -0,0 +1,177 @@
+/*
+ *	PERFT.C
+ *	Tom Kerrigan's Simple Chess Program (TSCP)
+ *
+ *	Copyright 2016 Tom Kerrigan
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "defs.h"
+#include "data.h"
+#include "protos.h"
+
+
+/* "Perft" (performance test) counts the positions that can be reached
+   from the current position in exactly depth moves. The counts for
+   lots of positions are well known, so perft is a good way to find
+   bugs in the move generator and in makemove() and takeback(). It's
+   also a good way to measure how fast they are, because unlike
+   bench, it doesn't depend on the search or the evaluation function.
+
+   Since our move generator makes pseudo-legal moves, we still have
+   to make the moves one ply from the end to see if they're legal,
+   but we don't call gen() in the positions after them; we just count
+   the legal moves ("bulk counting").
+
+   Optionally, the counts of positions searched at least two ply deep
+   are saved in a hash table, so transpositions don't have to be
+   counted again. The table is a tt_t (see hash.c) with the entries
+   packed differently: data holds the count in bits 0-55 and the depth
+   in bits 56-63, and key is the position's hash key XORed with data,
+   just like in the transposition table, so the threads can share the
+   table without locking it. Each position only has one slot, which is
+   always overwritten. */
+
+
+#define PERFT_COUNT(d)	((d) & 0x00ffffffffffffffULL)
+#define PERFT_DEPTH(d)	((int)((d) >> 56))
+
+
+/* the work that one thread does for perft_root() */
+typedef struct {
+	engine_t *e;  /* the engine the thread uses */
+	tt_t *t;  /* the hash table, or NULL */
+	int depth;
+	move *moves;  /* the legal moves at the root */
+	U64 *count;  /* the count for each of them */
+	int n;  /* the number of moves */
+	int first;  /* the first move the thread counts */
+	int step;  /* the thread counts every step-th move after that */
+} perft_job_t;
+
+
+/* perft() returns the number of positions depth ply from the current
+   position. t is the hash table, or NULL if there isn't one. */
+
+U64 perft(engine_t *e, int depth, tt_t *t)
+{
+	int i;
+	U64 n = 0;
+	U64 d;
+	tt_entry_t *p = NULL;
+
+	if (t && depth >= 2) {
+		p = &t->entry[(e->hash & t->mask) * TT_BUCKET + (depth & (TT_BUCKET - 1))];
+		d = p->data;
+		if ((p->key ^ d) == e->hash && PERFT_DEPTH(d) == depth)
+			return PERFT_COUNT(d);
+	}
+	gen(e);
+	for (i = e->first_move[e->ply]; i < e->first_move[e->ply + 1]; ++i) {
+		if (!makemove(e, e->gen_dat[i].m.b))
+			continue;
+		if (depth == 1)
+			++n;
+		else
+			n += perft(e, depth - 1, t);
+		takeback(e);
+	}
+	if (p) {
+		d = n | ((U64)depth << 56);
+		p->key = e->hash ^ d;
+		p->data = d;
+	}
+	return n;
+}
+
+
+/* perft_thread() counts a perft_job_t's share of the root moves. */
+
+void perft_thread(void *arg)
+{
+	perft_job_t *j = (perft_job_t *)arg;
+	int i;
+
+	for (i = j->first; i < j->n; i += j->step) {
+		if (j->depth == 1)
+			j->count[i] = 1;
+		else {
+			makemove(j->e, j->moves[i].b);
+			j->count[i] = perft(j->e, j->depth - 1, j->t);
+			takeback(j->e);
+		}
+	}
+}
+
+
+/* perft_root() runs perft to depth ply from the current position and
+   returns the count. The root moves are split among the engine's
+   threads (see set_threads()). If divide is TRUE, the count for each
+   root move is printed too, which helps narrow down a bug when the
+   total is wrong. hash_mb is the size of the hash table in megabytes,
+   or 0 for no hash table. */
+
+U64 perft_root(engine_t *e, int depth, BOOL divide, int hash_mb)
+{
+	move moves[256];
+	U64 count[256];
+	perft_job_t job[MAX_THREADS];
+	void *thread[MAX_THREADS];
+	tt_t t;
+	U64 total;
+	int n, i;
+
+	if (depth < 1)
+		return 1;
+	if (depth > MAX_PLY - 1)
+		depth = MAX_PLY - 1;
+
+	/* find the legal root moves */
+	n = 0;
+	gen(e);
+	for (i = e->first_move[e->ply]; i < e->first_move[e->ply + 1]; ++i) {
+		if (!makemove(e, e->gen_dat[i].m.b))
+			continue;
+		takeback(e);
+		moves[n++] = e->gen_dat[i].m;
+	}
+
+	t.entry = NULL;
+	if (hash_mb)
+		alloc_tt(&t, hash_mb);
+
+	/* the helpers take every threads-th move; this thread does the
+	   first share itself */
+	for (i = 0; i < e->threads; ++i) {
+		job[i].e = i ? get_helper(e, i) : e;
+		job[i].t = hash_mb ? &t : NULL;
+		job[i].depth = depth;
+		job[i].moves = moves;
+		job[i].count = count;
+		job[i].n = n;
+		job[i].first = i;
+		job[i].step = e->threads;
+		thread[i] = NULL;
+		if (i) {
+			copy_position(job[i].e, e);
+			thread[i] = start_thread(perft_thread, &job[i]);
+			if (!thread[i])  /* couldn't start it, so do it here */
+				perft_thread(&job[i]);
+		}
+	}
+	perft_thread(&job[0]);
+	for (i = 1; i < e->threads; ++i)
+		if (thread[i])
+			join_thread(thread[i]);
+	free(t.entry);
+
+	total = 0;
+	for (i = 0; i < n; ++i) {
+		if (divide)
+			printf("%s %llu\n", move_str(moves[i].b), count[i]);
+		total += count[i];
+	}
+	return total;
+}
@@ -9,49 +9,149 @@
 /* prototypes */
 
 /* board.c */
-void init_board();
+engine_t *new_engine(int hash_mb);
+void free_engine(engine_t *e);
+engine_t *get_helper(engine_t *e, int i);
+void copy_position(engine_t *to, engine_t *from);
+void init_board(engine_t *e);
+BOOL set_fen(engine_t *e, char *fen);
 void init_hash();
-int hash_rand();
-void set_hash();
-BOOL in_check(int s);
-BOOL attack(int sq, int s);
-void gen();
-void gen_caps();
-void gen_push(int from, int to, int bits);
-void gen_promote(int from, int to, int bits);
-BOOL makemove(move_bytes m);
-void takeback();
+U64 hash_rand();
+void set_hash(engine_t *e);
+void set_bitboards(engine_t *e);
+void add_piece(engine_t *e, int sq, int c, int p);
+void remove_piece(engine_t *e, int sq);
+BOOL in_check(engine_t *e, int s);
+BOOL attack(engine_t *e, int sq, int s);
+U64 attackers(engine_t *e, int sq, U64 occ);
+int see(engine_t *e, move m);
+void gen(engine_t *e);
+void gen_caps(engine_t *e);
+void gen_quiets(engine_t *e);
+BOOL move_ok(engine_t *e, move m);
+void gen_push(engine_t *e, int from, int to, int bits);
+void gen_promote(engine_t *e, int from, int to, int bits);
+BOOL makemove(engine_t *e, move_bytes m);
+void takeback(engine_t *e);
+void make_null(engine_t *e);
+void take_null(engine_t *e);
+
+/* bitboard.c */
+U64 slider_attacks(int sq, U64 occ, int dr[4], int dc[4]);
+U64 magic_rand();
+void init_magics(magic_t *m, U64 *table, int dr[4], int dc[4]);
+void init_bitboards();
+int lsb(U64 b);
+int popcount(U64 b);
+
+/* hash.c */
+void alloc_tt(tt_t *t, int mb);
+void clear_tt(tt_t *t);
+BOOL probe_tt(engine_t *e, int depth, int alpha, int beta, int *score, move *m);
+void store_tt(engine_t *e, int depth, int score, int flags, move m);
+
+/* thread.c */
+void *start_thread(void (*f)(void *), void *arg);
+void join_thread(void *p);
+BOOL start_detached(void (*f)(void *), void *arg);
+void *new_mutex();
+void lock_mutex(void *p);
+void unlock_mutex(void *p);
+void free_mutex(void *p);
+void *new_cond();
+void free_cond(void *p);
+void wait_cond(void *c, void *m);
+void signal_cond(void *c);
+
+/* input.c */
+void start_input(engine_t *e);
+void stop_input();
+void input_thread(void *arg);
+BOOL stop_command(engine_t *e, char *s);
+BOOL hit_command(engine_t *e, char *s);
+void ponder_clock(engine_t *e, char *s);
+BOOL get_line(char *s, int size);
+void input_search(engine_t *e, BOOL searching);
+void wait_stop(engine_t *e);
+
+/* perft.c */
+U64 perft(engine_t *e, int depth, tt_t *t);
+void perft_thread(void *arg);
+U64 perft_root(engine_t *e, int depth, BOOL divide, int hash_mb);
+
+/* epd.c */
+BOOL epd_op(char *line, char *op, char *s, int size);
+BOOL san_in(char *san, char *list);
+void epd_suite(engine_t *e, char *name);
+
+/* batch.c */
+void json_str(char *out, char *s);
+void batch_position(engine_t *e, char *fen, char *out);
+void batch_error(char *fen, char *out, char *error);
+void batch_thread(void *arg);
+void batch(engine_t *e, char *name);
 
 /* book.c */
 void open_book();
 void close_book();
-int book_move();
-BOOL book_match(char *s1, char *s2);
+int book_move(engine_t *e);
+BOOL make_book(char *in, char *out);
+U64 book_key(engine_t *e);
+int book_compare(const void *a, const void *b);
+U64 get_bytes(unsigned char *p, int n);
+void put_bytes(unsigned char *p, U64 x, int n);
 
 /* search.c */
-void think(int output);
-int search(int alpha, int beta, int depth);
-int quiesce(int alpha, int beta);
-int reps();
-void sort_pv();
-void sort(int from);
-void checkup();
+void think(engine_t *e, int output);
+void set_threads(engine_t *e, int n);
+void set_multipv(engine_t *e, int n);
+void set_clock(engine_t *e, int time, int inc, int movestogo);
+void search_helper(void *arg);
+void iterate(engine_t *e, int output);
+void print_line(engine_t *e, int output, int k);
+int search(engine_t *e, int alpha, int beta, int depth);
+int quiesce(engine_t *e, int alpha, int beta);
+int reps(engine_t *e);
+BOOL excluded(engine_t *e, move m);
+void init_picker(engine_t *e, picker_t *p, move hash_move, BOOL quiet);
+BOOL next_move(engine_t *e, picker_t *p, move *m);
+BOOL bad_capture(engine_t *e, move m);
+void add_killer(engine_t *e, move m);
+void add_counter(engine_t *e, move m, int depth);
+void sort(engine_t *e, int from);
+void checkup(engine_t *e);
+int search_time(engine_t *e);
 
 /* eval.c */
-int eval();
-int eval_light_pawn(int sq);
-int eval_dark_pawn(int sq);
-int eval_light_king(int sq);
-int eval_lkp(int f);
-int eval_dark_king(int sq);
-int eval_dkp(int f);
+void init_eval();
+int eval(engine_t *e);
+void eval_pawns(engine_t *e, int score[2]);
+int eval_light_pawn(engine_t *e, int sq);
+int eval_dark_pawn(engine_t *e, int sq);
+int eval_light_king(engine_t *e, int sq);
+int eval_lkp(engine_t *e, int f);
+int eval_dark_king(engine_t *e, int sq);
+int eval_dkp(engine_t *e, int f);
 
 /* main.c */
+U64 get_ns();
 int get_ms();
-int main();
-int parse_move(char *s);
+int main(int argc, char *argv[]);
+int parse_move(engine_t *e, char *s);
 char *move_str(move_bytes m);
-void print_board();
-void xboard();
-void print_result();
-void bench();
+char *move_to_str(move_bytes m, char *str);
+char *move_san(engine_t *e, move_bytes m);
+int parse_san(engine_t *e, char *s);
+void san_strip(char *s, char *t);
+void print_board(engine_t *e);
+void xboard(engine_t *e);
+BOOL xboard_ponder(engine_t *e, move m, int post, int inc, int movestogo);
+int sel_flag(char *name);
+void uci(engine_t *e);
+void uci_id();
+void uci_option(engine_t *e, char *line);
+void uci_position(engine_t *e, char *line);
+void uci_go(engine_t *e, char *line);
+move expected_reply(engine_t *e);
+void print_result(engine_t *e);
+void bench(engine_t *e);
@@ -13,147 +13,597 @@
 #include "protos.h"
 
 
-/* see the beginning of think() */
-#include <setjmp.h>
-jmp_buf env;
-BOOL stop_search;
-
-
-/* think() calls search() iteratively. Search statistics
-   are printed depending on the value of output:
+/* think() searches the current position with "Lazy SMP": besides
+   the main thread, threads - 1 helper threads search the same
+   position, each with its own copy of the board. The threads don't
+   talk to each other except through the transposition table, where
+   they find the results of each other's searches. That alone makes
+   the main thread finish its iterations sooner. To make the threads
+   do somewhat different work, every other helper starts one ply
+   deeper. When the main thread is done, the helpers are stopped and
+   the main thread's PV is the result. The search can also be stopped
+   early by setting stop_search from another thread.
+   When pondering, think() doesn't return before the opponent moves:
+   if the search finishes sooner, it waits for the ponder hit (or for
+   the search to be stopped). An infinite search (UCI's "go infinite")
+   likewise waits to be stopped.
+   Search statistics are printed depending on the value of output:
    0 = no output
    1 = normal output
-   2 = xboard format output */
+   2 = xboard format output
+   3 = UCI format output */
 
-void think(int output)
+void think(engine_t *e, int output)
 {
-	int i, j, x;
-
-	/* try the opening book first */
-	pv[0][0].u = book_move();
-	if (pv[0][0].u != -1)
-		return;
+	int i;
+	engine_t *h;
+	void *thread[MAX_THREADS];
+
+	/* try the opening book first (but not when pondering or searching
+	   infinitely, because then we can't return right away) */
+	if (!e->pondering && !e->infinite) {
+		e->pv[0][0].u = book_move(e);
+		if (e->pv[0][0].u != -1) {
+			e->pv_length[0] = 1;
+			return;
+		}
+	}
 
-	/* some code that lets us longjmp back here and return
-	   from think() when our time is up */
-	stop_search = FALSE;
-	setjmp(env);
-	if (stop_search) {
-		
-		/* make sure to take back the line we were searching */
-		while (ply)
-			takeback();
-		return;
+	e->start_time = get_ns();
+	e->stop_time = e->start_time + (U64)e->max_time * 1000000;
+	++e->tt->age;
+
+	/* give each helper a copy of the position and start it. while
+	   pondering, the helpers don't get a time limit; their master
+	   stops them. */
+	e->stop_search = FALSE;
+	e->ponder_hit = FALSE;
+	e->ponder_time = -1;
+	input_search(e, TRUE);
+	for (i = 1; i < e->threads; ++i) {
+		h = get_helper(e, i);
+		copy_position(h, e);
+		h->max_depth = e->max_depth;
+		h->selective = e->selective;
+		h->start_time = e->start_time;
+		h->stop_time = e->pondering ? (U64)-1 : e->stop_time;
+		h->stop_search = FALSE;
+		thread[i] = start_thread(search_helper, h);
 	}
 
-	start_time = get_ms();
-	stop_time = start_time + max_time;
+	iterate(e, output);
+	if (e->pondering || e->infinite)
+		wait_stop(e);
+	e->pondering = FALSE;
+	e->infinite = FALSE;
+	input_search(e, FALSE);
+
+	e->stop_search = TRUE;
+	for (i = 1; i < e->threads; ++i)
+		if (thread[i]) {
+			join_thread(thread[i]);
+			e->nodes += e->helper[i]->nodes;
+		}
+}
+
+
+/* set_threads() sets the number of threads that think() uses. */
+
+void set_threads(engine_t *e, int n)
+{
+	if (n < 1)
+		n = 1;
+	if (n > MAX_THREADS)
+		n = MAX_THREADS;
+	e->threads = n;
+}
+
+
+/* set_multipv() sets the number of lines that think() finds (see
+   iterate()). */
+
+void set_multipv(engine_t *e, int n)
+{
+	if (n < 1)
+		n = 1;
+	if (n > MAX_MULTIPV)
+		n = MAX_MULTIPV;
+	e->multipv = n;
+}
+
+
+/* set_clock() sets the time limits for a move when the engine is
+   playing with a clock. time is the time left on the clock, inc is the
+   increment, and movestogo is the number of moves until the next time
+   control (0 if there isn't one), all in milliseconds. The engine
+   would like to use its share of the time left plus most of the
+   increment (soft_time), but iterate() uses more when the search is
+   unstable, up to four times as much, and never more than half of the
+   time left unless this is the last move before the time control
+   (max_time). */
 
-	ply = 0;
-	nodes = 0;
+void set_clock(engine_t *e, int time, int inc, int movestogo)
+{
+	int moves = 30;  /* the number of moves we expect to still play */
+
+	if (movestogo > 0 && movestogo < moves)
+		moves = movestogo;
+	time -= 50;  /* leave a little for the GUI and the operating system */
+	if (time < 1)
+		time = 1;
+	e->soft_time = time / moves + inc * 3 / 4;
+	e->max_time = e->soft_time * 4;
+	if (moves > 1 && e->max_time > time / 2)
+		e->max_time = time / 2;
+	if (e->max_time > time)
+		e->max_time = time;
+	if (e->max_time < 1)
+		e->max_time = 1;
+	if (e->soft_time > e->max_time)
+		e->soft_time = e->max_time;
+}
+
+
+/* search_helper() is the function that each helper thread runs. arg
+   is the helper engine. */
+
+void search_helper(void *arg)
+{
+	iterate((engine_t *)arg, 0);
+}
+
+
+/* iterate() calls search() iteratively. If the search is stopped in
+   the middle of an iteration, the PV of the last iteration that
+   finished is restored, because the unfinished one might not have
+   looked at the best move yet.
+
+   In multi-PV mode, each iteration searches the root multipv times:
+   first normally, to find the best move, then with that move
+   excluded, to find the second best, and so on. The searches share
+   the transposition table and the history tables, so the later ones
+   are much cheaper than the first. */
+
+void iterate(engine_t *e, int output)
+{
+	int i, j, k, x, t;
+	int alpha, beta, delta;
+	int lines;  /* the number of lines we search for */
+	BOOL follow;
+	pv_line_t l;
+	move last_pv[MAX_PLY];  /* the PV of the last finished iteration */
+	int last_length = 0;
+	U64 iter_start;  /* the time when this iteration started */
+	int unstable = 0;  /* how much the best move has been changing */
+	int limit;
+	BOOL dropped;
+
+	e->ply = 0;
+	e->nodes = 0;
+	e->next_check = POLL_MIN;
+	e->check_time = get_ns();
+	e->check_nodes = 0;
+	e->depth = 0;
+	e->score = 0;
+	e->lines = 0;
+	e->pv_index = 0;
+
+	memset(e->pv, 0, sizeof(e->pv));
+	memset(e->history, 0, sizeof(e->history));
+	memset(e->killer, 0, sizeof(e->killer));
+#ifdef USE_COUNTER
+	memset(e->counter, 0, sizeof(e->counter));
+	memset(e->cont_hist, 0, sizeof(e->cont_hist));
+#endif
+
+	/* there can't be more lines than legal moves */
+	lines = 1;
+	if (e->multipv > 1) {
+		gen(e);
+		for (j = e->first_move[0]; j < e->first_move[1]; ++j)
+			if (makemove(e, e->gen_dat[j].m.b)) {
+				takeback(e);
+				if (lines++ == e->multipv)
+					break;
+			}
+		if (--lines < 1)
+			lines = 1;
+	}
 
-	memset(pv, 0, sizeof(pv));
-	memset(history, 0, sizeof(history));
 	if (output == 1)
 		printf("ply      nodes  score  pv\n");
-	for (i = 1; i <= max_depth; ++i) {
-		follow_pv = TRUE;
-		x = search(-10000, 10000, i);
-		if (output == 1)
-			printf("%3d  %9d  %5d ", i, nodes, x);
-		else if (output == 2)
-			printf("%d %d %d %d",
-					i, x, (get_ms() - start_time) / 10, nodes);
-		if (output) {
-			for (j = 0; j < pv_length[0]; ++j)
-				printf(" %s", move_str(pv[0][j].b));
-			printf("\n");
-			fflush(stdout);
+	for (i = 1 + (e->id & 1); i <= e->max_depth; ++i) {
+		iter_start = get_ns();
+		for (k = 0; k < lines; ++k) {
+			e->pv_index = k;
+
+			/* follow this line's PV from the last iteration, unless
+			   its move has been taken by a better line since */
+			follow = TRUE;
+			if (k < e->lines) {
+				memcpy(e->pv[0], e->line[k].pv, sizeof(e->line[k].pv));
+				e->pv_length[0] = e->line[k].length;
+				for (j = 0; j < k; ++j)
+					if (e->line[j].pv[0].u == e->pv[0][0].u)
+						follow = FALSE;
+			}
+
+			/* aspiration windows: the score is probably close to the
+			   last iteration's, so search with a narrow window around
+			   it, which is faster. if the score turns out to be
+			   outside the window, we have to widen that side of the
+			   window and search again. */
+			alpha = -10000;
+			beta = 10000;
+			delta = ASPIRATION;
+			if (k < e->lines && e->line[k].score > -9000 && e->line[k].score < 9000) {
+				alpha = e->line[k].score - delta;
+				beta = e->line[k].score + delta;
+			}
+			for (;;) {
+				e->follow_pv = follow;
+				x = search(e, alpha, beta, i);
+				if (e->stop_search)
+					break;
+				delta *= 2;
+				if (delta > 500)
+					delta = 10000;
+				if (x <= alpha)
+					alpha = alpha - delta > -10000 ? alpha - delta : -10000;
+				else if (x >= beta)
+					beta = beta + delta < 10000 ? beta + delta : 10000;
+				else
+					break;
+			}
+			if (e->stop_search)
+				break;
+
+			/* insert the line so the lines stay sorted by score. the
+			   first k lines are still the ones whose moves were
+			   excluded, just in a different order. */
+			memcpy(l.pv, e->pv[0], sizeof(l.pv));
+			l.length = e->pv_length[0];
+			l.score = x;
+			for (j = k; j > 0 && e->line[j - 1].score < x; --j)
+				e->line[j] = e->line[j - 1];
+			e->line[j] = l;
 		}
-		if (x > 9000 || x < -9000)
+		e->pv_index = 0;
+		if (e->stop_search) {
+
+			/* if the best line of this iteration finished, use it,
+			   along with the other lines that finished */
+			if (k) {
+				memcpy(e->pv[0], e->line[0].pv, sizeof(e->line[0].pv));
+				e->pv_length[0] = e->line[0].length;
+				e->lines = k;
+				e->depth = i;
+				e->score = e->line[0].score;
+				if (output)
+					for (k = 0; k < e->lines; ++k)
+						print_line(e, output, k);
+			}
+			else if (last_length) {
+				memcpy(e->pv[0], last_pv, sizeof(last_pv));
+				e->pv_length[0] = last_length;
+			}
+
+			/* if not even the first iteration finished, any legal
+			   move will have to do */
+			else if (!e->pv[0][0].u) {
+				gen(e);
+				for (j = e->first_move[0]; j < e->first_move[1]; ++j)
+					if (makemove(e, e->gen_dat[j].m.b)) {
+						takeback(e);
+						e->pv[0][0] = e->gen_dat[j].m;
+						e->pv_length[0] = 1;
+						break;
+					}
+			}
 			break;
+		}
+		e->lines = lines;
+		memcpy(e->pv[0], e->line[0].pv, sizeof(e->line[0].pv));
+		e->pv_length[0] = e->line[0].length;
+		x = e->line[0].score;
+
+		/* did the best move change, or the score drop? */
+		unstable /= 2;
+		if (last_length && last_pv[0].u != e->pv[0][0].u)
+			unstable += 100;
+		dropped = last_length && x < e->score - 30;
+
+		memcpy(last_pv, e->pv[0], sizeof(last_pv));
+		last_length = e->pv_length[0];
+		e->depth = i;
+		e->score = x;
+		if (output)
+			for (k = 0; k < lines; ++k)
+				print_line(e, output, k);
+		if (x > 9000 || x < -9000 || !e->pv_length[0])
+			break;  /* a mate, or no legal moves */
+
+		/* is there time for another iteration? it will probably take
+		   at least twice as long as this one did, so if it can't
+		   finish before max_time, there's no point in starting it.
+		   (when pondering, there's no time limit yet.)
+		   with a clock, stop once we've used most of the time we
+		   wanted to use, but want more when the best move keeps
+		   changing (up to twice as much) or the score just dropped
+		   (half again as much), because then it's worth looking
+		   harder. */
+		if (!e->master && !e->pondering && e->max_time < (1 << 25)) {
+			t = search_time(e);
+			if (t + 2 * (int)((get_ns() - iter_start) / 1000000) > e->max_time)
+				break;
+			if (e->soft_time) {
+				limit = e->soft_time * (100 + unstable + (dropped ? 50 : 0)) / 100;
+				if (t >= limit * 6 / 10)
+					break;
+			}
+		}
 	}
 }
 
 
+/* print_line() prints line k of the last iteration in the format
+   that output asks for (see think()). The line is printed with one
+   printf(), so the input thread's readyok can't end up in the middle
+   of it. */
+
+void print_line(engine_t *e, int output, int k)
+{
+	char s[512];
+	char move[8];
+	int j, n, t;
+	int x = e->line[k].score;
+
+	if (output == 1)
+		n = sprintf(s, "%3d  %9d  %5d ", e->depth, e->nodes, x);
+	else if (output == 2)
+		n = sprintf(s, "%d %d %d %d",
+				e->depth, x, search_time(e) / 10, e->nodes);
+	else {
+		n = sprintf(s, "info depth %d ", e->depth);
+		if (e->multipv > 1)
+			n += sprintf(s + n, "multipv %d ", k + 1);
+		n += sprintf(s + n, "score ");
+		if (x > 9000)
+			n += sprintf(s + n, "mate %d", (10001 - x) / 2);
+		else if (x < -9000)
+			n += sprintf(s + n, "mate %d", -(10000 + x) / 2);
+		else
+			n += sprintf(s + n, "cp %d", x);
+		t = search_time(e);
+		n += sprintf(s + n, " nodes %d time %d", e->nodes, t);
+		if (t)
+			n += sprintf(s + n, " nps %d", (int)(e->nodes * 1000.0 / t));
+		n += sprintf(s + n, " pv");
+	}
+	for (j = 0; j < e->line[k].length; ++j)
+		n += sprintf(s + n, " %s", move_to_str(e->line[k].pv[j].b, move));
+	printf("%s\n", s);
+	fflush(stdout);
+}
+
+
 /* search() does just that, in negamax fashion */
 
-int search(int alpha, int beta, int depth)
+int search(engine_t *e, int alpha, int beta, int depth)
 {
-	int i, j, x;
+	int j, x, n, r;
 	BOOL c, f;
+	BOOL pv;  /* is this a PV node, i.e., not a zero-window search? */
+	BOOL futile;  /* can we skip quiet moves? */
+	BOOL quiet;  /* is the move a quiet move? (not a capture or promotion) */
+	BOOL check;  /* does the move give check? */
+	int static_eval;
+	picker_t p;
+	move m;
+	move hash_move;  /* the best move from the transposition table */
+	int hash_flags;  /* the type of score we'll store */
 
 	/* we're as deep as we want to be; call quiesce() to get
 	   a reasonable score and return it. */
 	if (!depth)
-		return quiesce(alpha,beta);
-	++nodes;
+		return quiesce(e, alpha,beta);
+	++e->nodes;
 
-	/* do some housekeeping every 1024 nodes */
-	if ((nodes & 1023) == 0)
-		checkup();
+	/* do some housekeeping once in a while */
+	if (e->nodes >= e->next_check)
+		checkup(e);
+	if (e->stop_search)
+		return 0;
 
-	pv_length[ply] = ply;
+	e->pv_length[e->ply] = e->ply;
 
 	/* if this isn't the root of the search tree (where we have
 	   to pick a move and can't simply return 0) then check to
 	   see if the position is a repeat. if so, we can assume that
 	   this line is a draw and return 0. */
-	if (ply && reps())
+	if (e->ply && reps(e))
 		return 0;
 
 	/* are we too deep? */
-	if (ply >= MAX_PLY - 1)
-		return eval();
-	if (hply >= HIST_STACK - 1)
-		return eval();
+	if (e->ply >= MAX_PLY - 1)
+		return eval(e);
+	if (e->hply >= HIST_STACK - 1)
+		return eval(e);
+
+	/* have we searched this position before? if so, we might already
+	   know its score. (at the root we always search, because we need
+	   a move, and at other PV nodes too, so the PV doesn't get cut
+	   short; there are few of them.) */
+	if (probe_tt(e, depth, alpha, beta, &x, &hash_move) &&
+			e->ply && beta - alpha == 1)
+		return x;
 
 	/* are we in check? if so, we want to search deeper */
-	c = in_check(side);
+	c = in_check(e, e->side);
 	if (c)
 		++depth;
-	gen();
-	if (follow_pv)  /* are we following the PV? */
-		sort_pv();
-	f = FALSE;
 
-	/* loop through the moves */
-	for (i = first_move[ply]; i < first_move[ply + 1]; ++i) {
-		sort(i);
-		if (!makemove(gen_dat[i].m.b))
+	/* the selective search. these only make sense at zero-window nodes,
+	   where we just want to know if the score is above or below beta,
+	   and not when we're in check, where we have to look at every
+	   move to be sure we aren't getting mated. */
+	pv = beta - alpha > 1;
+	futile = FALSE;
+	if (!pv && !c && e->ply && !e->follow_pv) {
+		static_eval = eval(e);
+
+		/* razoring: if the position is a lot worse than alpha this
+		   close to the horizon, it's unlikely that anything but a
+		   capture will save it, so see if the quiescence search
+		   agrees with that and if so, fail low right away */
+		if ((e->selective & SEL_RAZOR) && depth <= 3 && !hash_move.u &&
+				static_eval + razor_margin[depth] <= alpha) {
+			if (depth == 1)
+				return quiesce(e, alpha, beta);
+			x = quiesce(e, alpha - razor_margin[depth], alpha - razor_margin[depth] + 1);
+			if (e->stop_search)
+				return 0;
+			if (x <= alpha - razor_margin[depth])
+				return alpha;
+		}
+
+		/* null-move pruning: if the position is still good enough
+		   to fail high after we give the opponent a free move (and
+		   search less deeply), it's almost certainly good enough
+		   after a real move too. in a pawn ending that breaks down,
+		   because there giving up the move can be an advantage
+		   (zugzwang), so we only do it when we have pieces, and we
+		   don't do two null moves in a row. the reduction is 3 ply
+		   deep in the tree and 2 ply near the leaves and when there
+		   isn't much material left (adaptive null move, from
+		   Heinz's "Adaptive Null-Move Pruning"). */
+		if ((e->selective & SEL_NULL) && depth >= 2 &&
+				static_eval >= beta && beta < 9000 &&
+				e->piece_mat[e->side] &&
+				e->hist_dat[e->hply - 1].m.u) {
+			r = 2;
+			if (depth > 8 || (depth > 6 && e->piece_mat[LIGHT] >= 900 &&
+					e->piece_mat[DARK] >= 900))
+				r = 3;
+			e->first_move[e->ply + 1] = e->first_move[e->ply];
+			make_null(e);
+			x = -search(e, -beta, -beta + 1, depth - 1 - r > 0 ? depth - 1 - r : 0);
+			take_null(e);
+			if (e->stop_search)
+				return 0;
+			if (x >= beta)
+				return beta;
+		}
+
+		/* futility pruning: one or two ply from the horizon, if
+		   we're so far below alpha that a quiet move won't get us
+		   above it, skip the quiet moves */
+		if ((e->selective & SEL_FUTILITY) && depth <= 2 && alpha > -9000 &&
+				static_eval + futility_margin[depth] <= alpha)
+			futile = TRUE;
+	}
+
+	init_picker(e, &p, hash_move, TRUE);
+	f = FALSE;
+	n = 0;
+	hash_flags = HASH_ALPHA;
+	hash_move.u = 0;
+
+	/* loop through the moves. this is a principal variation search
+	   (PVS): we expect the first move to be the best one, so we only
+	   search it with the full window. the others we search with a
+	   zero window, just to prove that they're no better, which is
+	   cheaper. if one turns out to be better after all, we have to
+	   search it again with the full window to get its score. */
+	while (next_move(e, &p, &m)) {
+		if (!e->ply && excluded(e, m))
 			continue;
+		if (!makemove(e, m.b))
+			continue;
+		quiet = !(m.b.bits & (1 | 32));
+		check = in_check(e, e->side);
+		if (futile && f && quiet && !check) {
+			takeback(e);
+			continue;
+		}
+
+		/* late move reductions (LMR): the moves are ordered so that
+		   the later a quiet move comes, the less likely it is to be
+		   any good, so we search the late ones less deeply (very late
+		   ones two ply less, unless their history score says they've
+		   been good elsewhere). if one does turn out to be good, we
+		   search it again to the full depth. */
+		r = 0;
+		if ((e->selective & SEL_LMR) && depth >= 3 && n >= 3 &&
+				p.stage == PICK_QUIETS && !c && !check) {
+			r = 1;
+			if (n >= 6 && depth >= 5 &&
+					e->history[(int)m.b.from][(int)m.b.to] < depth * depth)
+				r = 2;
+		}
+
+		if (!f)
+			x = -search(e, -beta, -alpha, depth - 1);
+		else {
+			x = -search(e, -alpha - 1, -alpha, depth - 1 - r);
+			if (x > alpha && r && !e->stop_search)
+				x = -search(e, -alpha - 1, -alpha, depth - 1);
+			if (x > alpha && x < beta && !e->stop_search)
+				x = -search(e, -beta, -alpha, depth - 1);
+		}
 		f = TRUE;
-		x = -search(-beta, -alpha, depth - 1);
-		takeback();
+		++n;
+		takeback(e);
+
+		/* if the search was stopped, x is meaningless, so get out
+		   without touching the PV or the transposition table */
+		if (e->stop_search)
+			return 0;
 		if (x > alpha) {
 
 			/* this move caused a cutoff, so increase the history
 			   value so it gets ordered high next time we can
 			   search it */
-			history[(int)gen_dat[i].m.b.from][(int)gen_dat[i].m.b.to] += depth;
-			if (x >= beta)
+			e->history[(int)m.b.from][(int)m.b.to] += depth;
+			if (x >= beta) {
+				if (!(m.b.bits & (1 | 32))) {
+					add_killer(e, m);
+#ifdef USE_COUNTER
+					add_counter(e, m, depth);
+#endif
+				}
+				if (e->ply || !e->pv_index)
+					store_tt(e, depth, beta, HASH_BETA, m);
 				return beta;
+			}
 			alpha = x;
+			hash_flags = HASH_EXACT;
+			hash_move = m;
 
 			/* update the PV */
-			pv[ply][ply] = gen_dat[i].m;
-			for (j = ply + 1; j < pv_length[ply + 1]; ++j)
-				pv[ply][j] = pv[ply + 1][j];
-			pv_length[ply] = pv_length[ply + 1];
+			e->pv[e->ply][e->ply] = m;
+			for (j = e->ply + 1; j < e->pv_length[e->ply + 1]; ++j)
+				e->pv[e->ply][j] = e->pv[e->ply + 1][j];
+			e->pv_length[e->ply] = e->pv_length[e->ply + 1];
 		}
 	}
 
 	/* no legal moves? then we're in checkmate or stalemate */
 	if (!f) {
 		if (c)
-			return -10000 + ply;
+			return -10000 + e->ply;
 		else
 			return 0;
 	}
 
 	/* fifty move draw rule */
-	if (fifty >= 100)
+	if (e->fifty >= 100)
 		return 0;
+
+	/* the score of a root search with excluded moves isn't the
+	   position's score, so it doesn't go in the transposition table */
+	if (e->ply || !e->pv_index)
+		store_tt(e, depth, alpha, hash_flags, hash_move);
 	return alpha;
 }
 
@@ -165,102 +615,328 @@ int search(int alpha, int beta, int depth)
    is to find a position where there isn't a lot going on
    so the static evaluation function will work. */
 
-int quiesce(int alpha,int beta)
+int quiesce(engine_t *e, int alpha,int beta)
 {
-	int i, j, x;
-
-	++nodes;
-
-	/* do some housekeeping every 1024 nodes */
-	if ((nodes & 1023) == 0)
-		checkup();
+	int j, x;
+	picker_t p;
+	move m;
+	move hash_move;
+	int hash_flags;
+
+	++e->nodes;
+
+	/* do some housekeeping once in a while */
+	if (e->nodes >= e->next_check)
+		checkup(e);
+	if (e->stop_search)
+		return 0;
 
-	pv_length[ply] = ply;
+	e->pv_length[e->ply] = e->ply;
 
 	/* are we too deep? */
-	if (ply >= MAX_PLY - 1)
-		return eval();
-	if (hply >= HIST_STACK - 1)
-		return eval();
+	if (e->ply >= MAX_PLY - 1)
+		return eval(e);
+	if (e->hply >= HIST_STACK - 1)
+		return eval(e);
+
+	/* any search of this position will do, even another quiescence
+	   search, which we store with a depth of 0 */
+	if (probe_tt(e, 0, alpha, beta, &x, &hash_move))
+		return x;
 
 	/* check with the evaluation function */
-	x = eval();
-	if (x >= beta)
+	hash_flags = HASH_ALPHA;
+	x = eval(e);
+	if (x >= beta) {
+		store_tt(e, 0, beta, HASH_BETA, hash_move);
 		return beta;
-	if (x > alpha)
+	}
+	if (x > alpha) {
 		alpha = x;
+		hash_flags = HASH_EXACT;
+	}
 
-	gen_caps();
-	if (follow_pv)  /* are we following the PV? */
-		sort_pv();
+	init_picker(e, &p, hash_move, FALSE);
+	hash_move.u = 0;
 
 	/* loop through the moves */
-	for (i = first_move[ply]; i < first_move[ply + 1]; ++i) {
-		sort(i);
-		if (!makemove(gen_dat[i].m.b))
+	while (next_move(e, &p, &m)) {
+		if (!makemove(e, m.b))
 			continue;
-		x = -quiesce(-beta, -alpha);
-		takeback();
+		x = -quiesce(e, -beta, -alpha);
+		takeback(e);
+		if (e->stop_search)
+			return 0;
 		if (x > alpha) {
-			if (x >= beta)
+			if (x >= beta) {
+				store_tt(e, 0, beta, HASH_BETA, m);
 				return beta;
+			}
 			alpha = x;
+			hash_flags = HASH_EXACT;
+			hash_move = m;
 
 			/* update the PV */
-			pv[ply][ply] = gen_dat[i].m;
-			for (j = ply + 1; j < pv_length[ply + 1]; ++j)
-				pv[ply][j] = pv[ply + 1][j];
-			pv_length[ply] = pv_length[ply + 1];
+			e->pv[e->ply][e->ply] = m;
+			for (j = e->ply + 1; j < e->pv_length[e->ply + 1]; ++j)
+				e->pv[e->ply][j] = e->pv[e->ply + 1][j];
+			e->pv_length[e->ply] = e->pv_length[e->ply + 1];
 		}
 	}
+	store_tt(e, 0, alpha, hash_flags, hash_move);
 	return alpha;
 }
 
 
 /* reps() returns the number of times the current position
    has been repeated. It compares the current value of hash
-   to previous values. */
+   to previous values. (After set_fen(), fifty can be more than
+   hply, because the game history starts at the FEN.) */
 
-int reps()
+int reps(engine_t *e)
 {
 	int i;
 	int r = 0;
 
-	for (i = hply - fifty; i < hply; ++i)
-		if (hist_dat[i].hash == hash)
+	for (i = e->hply > e->fifty ? e->hply - e->fifty : 0; i < e->hply; ++i)
+		if (e->hist_dat[i].hash == e->hash)
 			++r;
 	return r;
 }
 
 
-/* sort_pv() is called when the search function is following
-   the PV (Principal Variation). It looks through the current
-   ply's move list to see if the PV move is there. If so,
-   it adds 10,000,000 to the move's score so it's played first
-   by the search function. If not, follow_pv remains FALSE and
-   search() stops calling sort_pv(). */
+/* excluded() returns TRUE if m is the move of one of the lines that
+   multi-PV mode has already found in this iteration, so the root
+   search has to skip it. */
 
-void sort_pv()
+BOOL excluded(engine_t *e, move m)
 {
 	int i;
 
-	follow_pv = FALSE;
-	for(i = first_move[ply]; i < first_move[ply + 1]; ++i)
-		if (gen_dat[i].m.u == pv[0][ply].u) {
-			follow_pv = TRUE;
-			gen_dat[i].score += 10000000;
-			return;
+	for (i = 0; i < e->pv_index; ++i)
+		if (e->line[i].pv[0].u == m.u)
+			return TRUE;
+	return FALSE;
+}
+
+
+/* init_picker() gets the move picker ready to hand out the moves
+   of the current ply. hash_move is the move to try first (usually
+   from the transposition table). If quiet is FALSE, only captures
+   and promotions are handed out.
+
+   If we're following the PV, the PV move is tried first instead of
+   the hash move. If the PV move isn't a move in this position, we've
+   left the PV, so follow_pv becomes FALSE and search() stops looking
+   at the PV. */
+
+void init_picker(engine_t *e, picker_t *p, move hash_move, BOOL quiet)
+{
+#ifdef USE_COUNTER
+	int to;
+#endif
+
+	e->first_move[e->ply + 1] = e->first_move[e->ply];
+	if (!quiet && !(hash_move.b.bits & (1 | 32)))
+		hash_move.u = 0;
+	if (e->follow_pv) {
+		e->follow_pv = FALSE;
+		if ((quiet || (e->pv[0][e->ply].b.bits & (1 | 32))) &&
+				move_ok(e, e->pv[0][e->ply])) {
+			e->follow_pv = TRUE;
+			hash_move = e->pv[0][e->ply];
 		}
+	}
+	p->stage = PICK_HASH;
+	p->quiet = quiet;
+	p->hash_move = hash_move;
+	p->killer[0] = e->killer[e->ply][0];
+	p->killer[1] = e->killer[e->ply][1];
+	p->counter.u = 0;
+	p->cont = NULL;
+#ifdef USE_COUNTER
+	if (e->hply && e->hist_dat[e->hply - 1].m.u) {  /* not after a null move */
+		to = e->hist_dat[e->hply - 1].m.b.to;
+		p->counter = e->counter[e->xside][e->piece[to]][to];
+		p->cont = e->cont_hist[e->piece[to]][to];
+	}
+#endif
 }
 
 
+/* next_move() puts the next move to search in *m and returns TRUE, or
+   returns FALSE if there are no more moves. The moves are handed out
+   in stages, and each stage only does its work when the previous one
+   has run out of moves, so when the first move causes a cutoff, we
+   haven't spent any time on the rest:
+
+   1. the hash move
+   2. good captures and promotions, best MVV/LVA score first
+   3. the two killer moves
+   4. the counter move to the opponent's last move
+   5. the other quiet moves, best history plus continuation history
+      score first
+   6. bad captures (see bad_capture()), except in quiesce()
+
+   The counter move and the continuation history are only used when
+   TSCP is built with USE_COUNTER defined (see the makefile);
+   otherwise there's no counter move and stage 5 sorts by history
+   alone. The hash move, the killer moves, and the counter move are
+   checked with move_ok() before they're handed out, and they're
+   skipped when they come up again in the later stages. The moves are pseudo-legal, just like
+   the ones from gen(). */
+
+BOOL next_move(engine_t *e, picker_t *p, move *m)
+{
+	int i, j;
+	gen_t g;
+
+	switch (p->stage) {
+		case PICK_HASH:
+			p->stage = PICK_GEN_CAPS;
+			if (p->hash_move.u && move_ok(e, p->hash_move)) {
+				*m = p->hash_move;
+				return TRUE;
+			}
+			/* fall through */
+		case PICK_GEN_CAPS:
+			gen_caps(e);
+			p->cur = e->first_move[e->ply];
+			p->bad_end = p->cur;
+			p->stage = PICK_GOOD_CAPS;
+			/* fall through */
+		case PICK_GOOD_CAPS:
+			while (p->cur < e->first_move[e->ply + 1]) {
+				sort(e, p->cur);
+				*m = e->gen_dat[p->cur++].m;
+				if (m->u == p->hash_move.u)
+					continue;
+
+				/* put bad captures aside for the last stage */
+				if (bad_capture(e, *m)) {
+					g = e->gen_dat[p->cur - 1];
+					e->gen_dat[p->cur - 1] = e->gen_dat[p->bad_end];
+					e->gen_dat[p->bad_end++] = g;
+					continue;
+				}
+				return TRUE;
+			}
+			/* the quiescence search doesn't search bad captures at
+			   all; they're very unlikely to raise alpha */
+			p->stage = p->quiet ? PICK_KILLER1 : PICK_DONE;
+			p->cur = e->first_move[e->ply];
+			return next_move(e, p, m);
+		case PICK_KILLER1:
+		case PICK_KILLER2:
+			i = p->stage - PICK_KILLER1;
+			++p->stage;
+			*m = p->killer[i];
+			if (m->u && m->u != p->hash_move.u && move_ok(e, *m))
+				return TRUE;
+			return next_move(e, p, m);
+		case PICK_COUNTER:
+			p->stage = PICK_GEN_QUIETS;
+			*m = p->counter;
+			if (m->u && m->u != p->hash_move.u &&
+					m->u != p->killer[0].u && m->u != p->killer[1].u &&
+					move_ok(e, *m))
+				return TRUE;
+			/* fall through */
+		case PICK_GEN_QUIETS:
+			p->quiet_start = e->first_move[e->ply + 1];
+			gen_quiets(e);
+			if (p->cont)
+				for (i = p->quiet_start; i < e->first_move[e->ply + 1]; ++i)
+					e->gen_dat[i].score += p->cont[e->piece[(int)e->gen_dat[i].m.b.from]][(int)e->gen_dat[i].m.b.to];
+
+			/* sort them by score with an insertion sort,
+			   which is fast for lists this short */
+			for (i = p->quiet_start + 1; i < e->first_move[e->ply + 1]; ++i) {
+				g = e->gen_dat[i];
+				for (j = i; j > p->quiet_start && e->gen_dat[j - 1].score < g.score; --j)
+					e->gen_dat[j] = e->gen_dat[j - 1];
+				e->gen_dat[j] = g;
+			}
+			p->cur = p->quiet_start;
+			p->stage = PICK_QUIETS;
+			/* fall through */
+		case PICK_QUIETS:
+			while (p->cur < e->first_move[e->ply + 1]) {
+				*m = e->gen_dat[p->cur++].m;
+				if (m->u != p->hash_move.u &&
+						m->u != p->killer[0].u &&
+						m->u != p->killer[1].u &&
+						m->u != p->counter.u)
+					return TRUE;
+			}
+			p->stage = PICK_BAD_CAPS;
+			p->cur = e->first_move[e->ply];
+			/* fall through */
+		case PICK_BAD_CAPS:
+			if (p->cur < p->bad_end) {
+				*m = e->gen_dat[p->cur++].m;
+				return TRUE;
+			}
+			p->stage = PICK_DONE;
+			/* fall through */
+		default:
+			return FALSE;
+	}
+}
+
+
+/* bad_capture() returns TRUE if the capture m loses material
+   according to the static exchange evaluator. Taking a piece that's
+   worth at least as much as the capturing piece can't lose material,
+   so we don't bother calling see() for those captures. */
+
+BOOL bad_capture(engine_t *e, move m)
+{
+	if (m.b.bits & (4 | 32))
+		return FALSE;
+	if (piece_value[e->piece[(int)m.b.to]] >= piece_value[e->piece[(int)m.b.from]])
+		return FALSE;
+	return see(e, m) < 0;
+}
+
+
+/* add_killer() remembers m, a quiet move that caused a beta cutoff,
+   as a killer move for the current ply. */
+
+void add_killer(engine_t *e, move m)
+{
+	if (e->killer[e->ply][0].u != m.u) {
+		e->killer[e->ply][1] = e->killer[e->ply][0];
+		e->killer[e->ply][0] = m;
+	}
+}
+
+
+#ifdef USE_COUNTER
+/* add_counter() remembers m, a quiet move that caused a beta cutoff
+   at depth depth, as the counter move to the opponent's last move, and
+   adds to its continuation history score. */
+
+void add_counter(engine_t *e, move m, int depth)
+{
+	int to;
+
+	if (!e->hply || !e->hist_dat[e->hply - 1].m.u)
+		return;
+	to = e->hist_dat[e->hply - 1].m.b.to;
+	e->counter[e->xside][e->piece[to]][to] = m;
+	e->cont_hist[e->piece[to]][to][e->piece[(int)m.b.from]][(int)m.b.to] += depth;
+}
+#endif
+
+
 /* sort() searches the current ply's move list from 'from'
    to the end to find the move with the highest score. Then it
    swaps that move and the 'from' move so the move with the
    highest score gets searched next, and hopefully produces
    a cutoff. */
 
-void sort(int from)
+void sort(engine_t *e, int from)
 {
 	int i;
 	int bs;  /* best score */
@@ -269,25 +945,65 @@ void sort(int from)
 
 	bs = -1;
 	bi = from;
-	for (i = from; i < first_move[ply + 1]; ++i)
-		if (gen_dat[i].score > bs) {
-			bs = gen_dat[i].score;
+	for (i = from; i < e->first_move[e->ply + 1]; ++i)
+		if (e->gen_dat[i].score > bs) {
+			bs = e->gen_dat[i].score;
 			bi = i;
 		}
-	g = gen_dat[from];
-	gen_dat[from] = gen_dat[bi];
-	gen_dat[bi] = g;
+	g = e->gen_dat[from];
+	e->gen_dat[from] = e->gen_dat[bi];
+	e->gen_dat[bi] = g;
 }
 
 
 /* checkup() is called once in a while during the search. */
 
-void checkup()
+void checkup(engine_t *e)
 {
-	/* is the engine's time up? if so, longjmp back to the
-	   beginning of think() */
-	if (get_ms() >= stop_time) {
-		stop_search = TRUE;
-		longjmp(env, 0);
+	U64 now = get_ns();
+	U64 n;
+
+	/* a ponder hit turns pondering into a normal search, which gets
+	   its time from now on, using the newest clock if there is one */
+	if (e->pondering && e->ponder_hit) {
+		if (e->ponder_time >= 0 && e->ponder_movestogo >= 0)
+			set_clock(e, e->ponder_time, e->ponder_inc, e->ponder_movestogo);
+		e->pondering = FALSE;
+		e->start_time = now;
+		e->stop_time = now + (U64)e->max_time * 1000000;
 	}
+
+	/* is the engine's time (or node count) up, or is this a helper
+	   thread whose master has stopped? if so, tell the search to
+	   stop */
+	if ((e->master && e->master->stop_search) ||
+			(!e->pondering && now >= e->stop_time) ||
+			(e->max_nodes && e->nodes >= e->max_nodes))
+		e->stop_search = TRUE;
+
+	/* looking at the clock isn't free, so we don't want to do it after
+	   every node, but we don't want to overshoot the time limit by
+	   much either. so we figure out how many nodes we searched per
+	   nanosecond since the last checkup() and come back after about
+	   POLL_NS nanoseconds' worth of them. */
+	n = POLL_MAX;
+	if (now > e->check_time)
+		n = (U64)(e->nodes - e->check_nodes) * POLL_NS / (now - e->check_time);
+	if (n < POLL_MIN)
+		n = POLL_MIN;
+	if (n > POLL_MAX)
+		n = POLL_MAX;
+	e->check_time = now;
+	e->check_nodes = e->nodes;
+	e->next_check = e->nodes + (int)n;
+	if (e->max_nodes && e->next_check > e->max_nodes)
+		e->next_check = e->max_nodes;
+}
+
+
+/* search_time() returns the milliseconds since the search started */
+
+int search_time(engine_t *e)
+{
+	return (int)((get_ns() - e->start_time) / 1000000);
 }
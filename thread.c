@@ -0,0 +1,249 @@
+/*
+ *	THREAD.C
+ *	Tom Kerrigan's Simple Chess Program (TSCP)
+ *
+ *	Copyright 2016 Tom Kerrigan
+ */
+
+
+/* These functions hide the differences between POSIX threads and
+   Windows threads from the rest of the program. Threads are passed
+   around as void pointers so that the other source files don't have
+   to include pthread.h or windows.h. (windows.h also defines BOOL,
+   which would clash with the BOOL in defs.h, so we include it before
+   our own headers.) */
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#include <stdlib.h>
+#include "defs.h"
+#include "data.h"
+#include "protos.h"
+
+
+typedef struct {
+#ifdef _WIN32
+	HANDLE handle;
+#else
+	pthread_t handle;
+#endif
+	void (*f)(void *);
+	void *arg;
+	BOOL detached;  /* nobody will join it, so it frees itself */
+} thread_t;
+
+
+#ifdef _WIN32
+DWORD WINAPI thread_main(LPVOID p)
+#else
+void *thread_main(void *p)
+#endif
+{
+	thread_t *t = (thread_t *)p;
+
+	t->f(t->arg);
+	if (t->detached)
+		free(t);
+	return 0;
+}
+
+
+/* start_thread() starts a thread that calls f(arg) and returns a
+   handle for join_thread(), or NULL if the thread couldn't be
+   started. */
+
+void *start_thread(void (*f)(void *), void *arg)
+{
+	thread_t *t;
+
+	t = (thread_t *)malloc(sizeof(thread_t));
+	if (!t)
+		return NULL;
+	t->f = f;
+	t->arg = arg;
+	t->detached = FALSE;
+#ifdef _WIN32
+	t->handle = CreateThread(NULL, 0, thread_main, t, 0, NULL);
+	if (!t->handle) {
+#else
+	if (pthread_create(&t->handle, NULL, thread_main, t)) {
+#endif
+		free(t);
+		return NULL;
+	}
+	return t;
+}
+
+
+/* start_detached() starts a thread that calls f(arg) and cleans up
+   after itself, for a thread that nobody waits for. It returns FALSE
+   if the thread couldn't be started. (The thread can free its
+   thread_t at any time, so we don't store its handle there.) */
+
+BOOL start_detached(void (*f)(void *), void *arg)
+{
+	thread_t *t;
+#ifdef _WIN32
+	HANDLE h;
+#else
+	pthread_t h;
+	pthread_attr_t attr;
+	int r;
+#endif
+
+	t = (thread_t *)malloc(sizeof(thread_t));
+	if (!t)
+		return FALSE;
+	t->f = f;
+	t->arg = arg;
+	t->detached = TRUE;
+#ifdef _WIN32
+	h = CreateThread(NULL, 0, thread_main, t, 0, NULL);
+	if (!h) {
+		free(t);
+		return FALSE;
+	}
+	CloseHandle(h);
+#else
+	if (pthread_attr_init(&attr)) {
+		free(t);
+		return FALSE;
+	}
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	r = pthread_create(&h, &attr, thread_main, t);
+	pthread_attr_destroy(&attr);
+	if (r) {
+		free(t);
+		return FALSE;
+	}
+#endif
+	return TRUE;
+}
+
+
+/* join_thread() waits for a thread to finish and frees its handle. */
+
+void join_thread(void *p)
+{
+	thread_t *t = (thread_t *)p;
+
+#ifdef _WIN32
+	WaitForSingleObject(t->handle, INFINITE);
+	CloseHandle(t->handle);
+#else
+	pthread_join(t->handle, NULL);
+#endif
+	free(t);
+}
+
+
+/* new_mutex() returns a mutex for lock_mutex() and unlock_mutex(), or
+   NULL if it couldn't make one. */
+
+void *new_mutex()
+{
+#ifdef _WIN32
+	CRITICAL_SECTION *m;
+
+	m = (CRITICAL_SECTION *)malloc(sizeof(CRITICAL_SECTION));
+	if (m)
+		InitializeCriticalSection(m);
+#else
+	pthread_mutex_t *m;
+
+	m = (pthread_mutex_t *)malloc(sizeof(pthread_mutex_t));
+	if (m && pthread_mutex_init(m, NULL)) {
+		free(m);
+		return NULL;
+	}
+#endif
+	return m;
+}
+
+
+void lock_mutex(void *p)
+{
+#ifdef _WIN32
+	EnterCriticalSection((CRITICAL_SECTION *)p);
+#else
+	pthread_mutex_lock((pthread_mutex_t *)p);
+#endif
+}
+
+
+void unlock_mutex(void *p)
+{
+#ifdef _WIN32
+	LeaveCriticalSection((CRITICAL_SECTION *)p);
+#else
+	pthread_mutex_unlock((pthread_mutex_t *)p);
+#endif
+}
+
+
+void free_mutex(void *p)
+{
+#ifdef _WIN32
+	DeleteCriticalSection((CRITICAL_SECTION *)p);
+#else
+	pthread_mutex_destroy((pthread_mutex_t *)p);
+#endif
+	free(p);
+}
+
+
+/* new_cond() returns a condition variable, or NULL if it couldn't
+   make one. wait_cond() unlocks mutex m, waits until another thread
+   calls signal_cond(), and locks m again. */
+
+void *new_cond()
+{
+#ifdef _WIN32
+	CONDITION_VARIABLE *c;
+
+	c = (CONDITION_VARIABLE *)malloc(sizeof(CONDITION_VARIABLE));
+	if (c)
+		InitializeConditionVariable(c);
+#else
+	pthread_cond_t *c;
+
+	c = (pthread_cond_t *)malloc(sizeof(pthread_cond_t));
+	if (c && pthread_cond_init(c, NULL)) {
+		free(c);
+		return NULL;
+	}
+#endif
+	return c;
+}
+
+
+void free_cond(void *p)
+{
+#ifndef _WIN32
+	pthread_cond_destroy((pthread_cond_t *)p);
+#endif
+	free(p);
+}
+
+
+void wait_cond(void *c, void *m)
+{
+#ifdef _WIN32
+	SleepConditionVariableCS((CONDITION_VARIABLE *)c, (CRITICAL_SECTION *)m, INFINITE);
+#else
+	pthread_cond_wait((pthread_cond_t *)c, (pthread_mutex_t *)m);
+#endif
+}
+
+
+void signal_cond(void *c)
+{
+#ifdef _WIN32
+	WakeConditionVariable((CONDITION_VARIABLE *)c);
+#else
+	pthread_cond_signal((pthread_cond_t *)c);
+#endif
+}